@@ -0,0 +1,446 @@
+// Host benchmark: runs the firmware against the mocks in bench/mocks for a
+// number of report intervals and prints what one interval costs. Each
+// native* environment in platformio.ini builds one mode:
+//
+//   pio run -e native_batched && .pio/build/native_batched/program [intervals] [options]
+//
+//   --verbose            show the firmware's serial output
+//   --outage FROM TO     make the access point unreachable between the
+//                        given hours of simulated time
+//   --events             add a heating burst every few hours, for
+//                        ADAPTIVE_INTERVAL to react to
+//   --config JSON        have the backend answer every upload with this
+//                        config block (REMOTE_CONFIG)
+//   --unplug FROM TO     take every sensor off the bus between the given
+//                        hours
+//   --stuck-bus AT       have a sensor hold SDA low from the given hour
+//                        until the firmware clocks it free
+//   --crash AT           have the watchdog reset an always-on node at the
+//                        given hour, and check that the uploads after it
+//                        count the reset and carry sane ages
+//   --pipeline           time BME280 compensation, filtering and scaling
+//                        on the float and the FIXED_POINT path instead
+//
+// The host has an FPU, so --pipeline understates what the float path
+// costs on the L106, where every operation is a soft-float call; it shows
+// the integer path is no slower even there, and that both agree.
+// Deep-sleep builds start a fresh copy of this program for every wake, so
+// globals and static initialisation run again as after a real reset; RTC
+// memory, the clock and the counters live in a shared file mapping that
+// survives the hand-over. Always-on builds run setup() once and loop()
+// until the simulated time is up, in a fresh process again after a
+// --crash reset. A run without an outage that made no upload, or whose
+// uploads after a crash failed the checks, exits with status 1. Needs a
+// POSIX host.
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <chrono>
+#include <new>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "main.h"
+#include "bme280_sensor.h"
+#include "rtc_state.h"
+#include "sample_filter.h"
+
+void setup();
+void loop();
+
+Sim* sim = nullptr;
+
+namespace {
+
+typedef std::chrono::steady_clock HostClock;
+
+HostClock::time_point wakeStart;
+bool inWake = false;
+
+// Allocations made during static initialisation, before `sim` is mapped.
+size_t liveBytes = 0;
+uint64_t earlyAllocs = 0;
+uint64_t earlyBytes = 0;
+
+void* allocate(size_t n) {
+    void* p = malloc(n + sizeof(max_align_t));
+    if (!p) throw std::bad_alloc();
+    *static_cast<size_t*>(p) = n;
+    liveBytes += n;
+
+    if (!sim) {
+        earlyAllocs++;
+        earlyBytes += n;
+    } else if (sim->countAllocs) {
+        sim->counters.allocs++;
+        sim->counters.allocBytes += n;
+    }
+    return static_cast<char*>(p) + sizeof(max_align_t);
+}
+
+void release(void* p) {
+    if (!p) return;
+    char* base = static_cast<char*>(p) - sizeof(max_align_t);
+    liveBytes -= *reinterpret_cast<size_t*>(base);
+    free(base);
+}
+
+Sim* mapSim(int fd) {
+    void* p = mmap(nullptr, sizeof(Sim), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    return static_cast<Sim*>(p);
+}
+
+// Power-on or reset: the radio starts idle and is calibrated unless the
+// previous deepSleep() asked for RF_DISABLED.
+void boot() {
+    sim->bootUs = sim->clockUs;
+    sim->radioOn = false;
+    sim->associated = false;
+    sim->associating = false;
+    sim->sleepType = WIFI_NONE_SLEEP;
+    sim->counters.wakes++;
+    if (!sim->rfDisabled) {
+        sim->counters.radioWakes++;
+        sim->counters.radioUs += SimModel::RF_CAL_US;
+    }
+
+    sim->counters.allocs += earlyAllocs;
+    sim->counters.allocBytes += earlyBytes;
+    sim->countAllocs = true;
+}
+
+uint64_t elapsedNs(HostClock::time_point since) {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(HostClock::now() - since).count();
+}
+
+int runWake(int fd) {
+    sim = mapSim(fd);
+    inWake = true;
+    boot();
+
+    wakeStart = HostClock::now();
+    setup();
+
+    fprintf(stderr, "setup() returned without going to deep sleep\n");
+    return 1;
+}
+
+#if DEEP_SLEEP
+bool runDeepSleep(const char* self, int fd, int intervals) {
+    char fdArg[16];
+    snprintf(fdArg, sizeof(fdArg), "%d", fd);
+
+    // Wakes needed to cover the run; deadband hand-over wakes come on top.
+    uint64_t endUs = (uint64_t)intervals * INTERVAL_MS * 1000;
+    while (sim->clockUs < endUs) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return false;
+        }
+        if (pid == 0) {
+            execlp(self, self, "--wake", fdArg, (char*)nullptr);
+            perror("exec");
+            _exit(1);
+        }
+
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "wake %u failed\n", sim->counters.wakes);
+            return false;
+        }
+    }
+    return true;
+}
+#else
+// The watchdog resets the chip: the firmware starts over from setup() in
+// a fresh process, with RTC memory and the clock carried over.
+[[noreturn]] void watchdogReset(const char* self, int fd, int intervals) {
+    sim->countAllocs = false;
+    sim->counters.awakeUs += sim->clockUs - sim->bootUs;
+    sim->radioOn = false;
+    sim->crashed = true;
+    sim->resetReason = REASON_WDT_RST;
+
+    char fdArg[16], intervalsArg[16];
+    snprintf(fdArg, sizeof(fdArg), "%d", fd);
+    snprintf(intervalsArg, sizeof(intervalsArg), "%d", intervals);
+    fflush(stdout);
+    execlp(self, self, "--reset", fdArg, intervalsArg, (char*)nullptr);
+    perror("exec");
+    _exit(1);
+}
+
+void runAlwaysOn(const char* self, int fd, int intervals) {
+    boot();
+
+    HostClock::time_point start = HostClock::now();
+    setup();
+    sim->counters.cpuNs += elapsedNs(start);
+
+    uint64_t endUs = (uint64_t)intervals * INTERVAL_MS * 1000;
+    while (sim->clockUs < endUs) {
+        if (sim->crashAtUs && !sim->crashed && sim->clockUs >= sim->crashAtUs) watchdogReset(self, fd, intervals);
+        start = HostClock::now();
+        loop();
+        sim->counters.cpuNs += elapsedNs(start);
+    }
+
+    sim->countAllocs = false;
+    sim->counters.awakeUs += sim->clockUs - sim->bootUs;
+}
+#endif
+
+void report(int intervals) {
+    const SimCounters& c = sim->counters;
+    double n = intervals;
+
+    printf("mode                %s (%s)\n", BENCH_MODE_NAME, DEEP_SLEEP ? "deep sleep" : "always on");
+    printf("intervals           %d x %u ms, %u wakes\n", intervals, (unsigned)INTERVAL_MS, c.wakes);
+    printf("rtc ring            %u records\n", (unsigned)RTC_RING_SIZE);
+    if (sim->outageToUs > sim->outageFromUs) {
+        printf("outage              %.1f h to %.1f h\n", sim->outageFromUs / 3.6e9, sim->outageToUs / 3.6e9);
+    }
+    if (sim->events) printf("events              heating burst every %.0f h\n", SimModel::EVENT_EVERY_H);
+    if (sim->unplugToUs > sim->unplugFromUs) {
+        printf("sensors unplugged   %.1f h to %.1f h\n", sim->unplugFromUs / 3.6e9, sim->unplugToUs / 3.6e9);
+    }
+    if (sim->stuckBusAtUs) printf("bus stuck           at %.1f h\n", sim->stuckBusAtUs / 3.6e9);
+    if (sim->crashAtUs) printf("watchdog reset      at %.1f h\n", sim->crashAtUs / 3.6e9);
+    printf("per interval:\n");
+    printf("  host cpu          %.1f us\n", c.cpuNs / n / 1000.0);
+    printf("  heap allocations  %.2f (%.1f bytes)\n", c.allocs / n, c.allocBytes / n);
+    printf("  awake             %.1f ms\n", c.awakeUs / n / 1000.0);
+    printf("  radio on          %.1f ms\n", c.radioUs / n / 1000.0);
+    printf("  uploads           %.3f (%.1f payload bytes)\n", c.requests / n, c.bytesSent / n);
+    printf("totals:\n");
+    printf("  radio wakes       %u\n", c.radioWakes);
+    printf("  associations      %u\n", c.associations);
+    printf("  uploads           %u\n", c.requests);
+    printf("  sensor reads      %u (1 in %u is a glitch)\n", c.sensorReads, SimModel::GLITCH_EVERY);
+    printf("  sntp queries      %u\n", c.ntpQueries);
+    if (sim->stuckBusAtUs) printf("  bus recoveries    %u\n", c.busRecoveries);
+    if (sim->crashAtUs) {
+        printf("  after the reset   %u uploads, reset %s, %u rows with a bad age\n", sim->uploadsAfterCrash,
+               sim->crashReported ? "reported" : "not reported", sim->badAges);
+    }
+    if (sim->configReply[0]) printf("  config replies    %u of %s\n", c.configReplies, sim->configReply);
+    if (OTA) printf("  ota checks        %u\n", c.otaChecks);
+    if (c.tlsFullHandshakes || c.tlsResumed) {
+        printf("  tls handshakes    %u full, %u resumed\n", c.tlsFullHandshakes, c.tlsResumed);
+    }
+    if (c.bursts) {
+        printf("  slot lag          %.1f ms mean, %.1f ms max over %u samples\n", c.slotLagUs / 1000.0 / c.bursts,
+               c.slotLagMaxUs / 1000.0, c.bursts);
+    }
+}
+
+// Raw data blocks around the datasheet calibration example, with noise.
+std::vector<BME280Device::RawReading> pipelineInput(size_t n) {
+    std::vector<BME280Device::RawReading> raws(n);
+    uint32_t rng = 12345;
+    for (BME280Device::RawReading& r : raws) {
+        rng = rng * 1103515245 + 12345;
+        int32_t noise = (int32_t)((rng >> 16) % 401) - 200;
+        r = { 415148 + noise / 4, 519888 + noise, 28800 + noise / 3 };
+    }
+    return raws;
+}
+
+// One report: SAMPLE_SIZE readings through convert() and the configured
+// filter, then scaling to the stored integers. Returns host ns per report.
+template <typename T>
+double timePipeline(BME280Device& dev, const std::vector<BME280Device::RawReading>& raws, int reports,
+                    std::vector<int32_t>& out) {
+    constexpr size_t CH = BME280Sensor::CHANNEL_COUNT;
+    out.assign((size_t)reports * CH, 0);
+    size_t next = 0;
+
+    HostClock::time_point start = HostClock::now();
+    for (int r = 0; r < reports; r++) {
+        SampleFilter<SAMPLE_SIZE, T> filters[CH];
+        for (int i = 0; i < SAMPLE_SIZE; i++) {
+            T values[CH];
+            for (T& v : values) v = Reading<T>::NONE;
+            BME280Sensor::convert(dev, raws[next++ % raws.size()], values);
+            for (size_t ch = 0; ch < CH; ch++) {
+                if (Reading<T>::present(values[ch])) filters[ch].add(values[ch]);
+            }
+        }
+        for (size_t ch = 0; ch < CH; ch++) {
+            uint8_t decimals = formatOf(BME280Sensor::CHANNELS[ch].quantity).decimals;
+            out[(size_t)r * CH + ch] = Reading<T>::stored(filters[ch].result(), decimals);
+        }
+    }
+    return elapsedNs(start) / (double)reports;
+}
+
+int runPipeline() {
+    BME280Device dev;
+    dev.begin(SimModel::BME280_ADDR);
+    std::vector<BME280Device::RawReading> raws = pipelineInput(4096);
+
+    const int reports = 20000;
+    std::vector<int32_t> floats, fixed;
+    timePipeline<float>(dev, raws, reports / 10, floats);   // warm-up
+    double floatNs = timePipeline<float>(dev, raws, reports, floats);
+    double fixedNs = timePipeline<int32_t>(dev, raws, reports, fixed);
+
+    uint32_t differ = 0;
+    int32_t maxDiff = 0;
+    for (size_t i = 0; i < floats.size(); i++) {
+        int32_t d = abs(floats[i] - fixed[i]);
+        differ += d != 0;
+        if (d > maxDiff) maxDiff = d;
+    }
+
+    printf("pipeline            %d reports x %d readings, 1 BME280\n", reports, SAMPLE_SIZE);
+    printf("  float             %.1f ns per report\n", floatNs);
+    printf("  fixed point       %.1f ns per report\n", fixedNs);
+    printf("  differences       %u of %zu values (max %d LSB)\n", differ, floats.size(), maxDiff);
+    return 0;
+}
+
+// Prints the report and removes the flash directory; the exit status of
+// the run.
+int finish(int intervals) {
+    report(intervals);
+
+    std::string cleanup = std::string("rm -rf '") + sim->fsRoot + "'";
+    if (system(cleanup.c_str()) != 0) return 1;
+
+    // Without an outage every mode uploads at some point; a run that never
+    // did is a scheduling bug, not a number to report.
+    if (!sim->counters.requests && sim->outageToUs <= sim->outageFromUs) {
+        fprintf(stderr, "no uploads in %d intervals\n", intervals);
+        return 1;
+    }
+    if (sim->crashAtUs && !sim->crashed) {
+        fprintf(stderr, "the run ended before the watchdog reset\n");
+        return 1;
+    }
+    if (sim->crashAtUs && (!sim->crashReported || sim->badAges)) {
+        fprintf(stderr, "uploads after the watchdog reset are wrong\n");
+        return 1;
+    }
+    return 0;
+}
+} // namespace
+
+size_t benchLiveBytes() { return liveBytes; }
+
+void benchDeepSleep(uint64_t sleepUs, bool rfDisabled) {
+    if (!inWake) {
+        fprintf(stderr, "deep sleep requested by an always-on build\n");
+        exit(1);
+    }
+
+    sim->countAllocs = false;
+    sim->counters.cpuNs += elapsedNs(wakeStart);
+    sim->counters.awakeUs += sim->clockUs - sim->bootUs;
+    sim->clockUs += sleepUs * (1000000 + SimModel::SLEEP_DRIFT_PPM) / 1000000;
+    sim->rfDisabled = rfDisabled;
+    sim->radioOn = false;
+    sim->resetReason = REASON_DEEP_SLEEP_AWAKE;
+    fflush(stdout);
+    _exit(0);
+}
+
+void* operator new(size_t n)              { return allocate(n); }
+void* operator new[](size_t n)            { return allocate(n); }
+void operator delete(void* p) noexcept    { release(p); }
+void operator delete[](void* p) noexcept  { release(p); }
+void operator delete(void* p, size_t) noexcept   { release(p); }
+void operator delete[](void* p, size_t) noexcept { release(p); }
+
+int main(int argc, char** argv) {
+    if (argc == 3 && !strcmp(argv[1], "--wake")) return runWake(atoi(argv[2]));
+#if !DEEP_SLEEP
+    if (argc == 4 && !strcmp(argv[1], "--reset")) {
+        int fd = atoi(argv[2]);
+        sim = mapSim(fd);
+        runAlwaysOn(argv[0], fd, atoi(argv[3]));
+        return finish(atoi(argv[3]));
+    }
+#endif
+
+    int intervals = 48;
+    bool verbose = false;
+    bool pipeline = false;
+    bool events = false;
+    const char* config = "";
+    double outageFromH = 0, outageToH = 0;
+    double unplugFromH = 0, unplugToH = 0, stuckBusH = 0, crashH = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--verbose")) {
+            verbose = true;
+        } else if (!strcmp(argv[i], "--events")) {
+            events = true;
+        } else if (!strcmp(argv[i], "--pipeline")) {
+            pipeline = true;
+        } else if (!strcmp(argv[i], "--config") && i + 1 < argc) {
+            config = argv[++i];
+        } else if (!strcmp(argv[i], "--outage") && i + 2 < argc) {
+            outageFromH = atof(argv[++i]);
+            outageToH = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--unplug") && i + 2 < argc) {
+            unplugFromH = atof(argv[++i]);
+            unplugToH = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--stuck-bus") && i + 1 < argc) {
+            stuckBusH = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--crash") && i + 1 < argc && !DEEP_SLEEP) {
+            crashH = atof(argv[++i]);
+        } else {
+            intervals = atoi(argv[i]);
+        }
+    }
+    if (intervals <= 0) {
+        fprintf(stderr, "usage: %s [intervals] [--verbose] [--outage FROM_H TO_H] [--events] [--config JSON]\n"
+                "       [--unplug FROM_H TO_H] [--stuck-bus AT_H] [--crash AT_H] [--pipeline]\n", argv[0]);
+        return 2;
+    }
+    if (pipeline) return runPipeline();
+
+    FILE* shared = tmpfile();
+    if (!shared || ftruncate(fileno(shared), sizeof(Sim)) != 0) {
+        perror("tmpfile");
+        return 1;
+    }
+    int fd = fileno(shared);
+    fcntl(fd, F_SETFD, 0);   // keep it open across exec
+
+    sim = mapSim(fd);
+    memset(sim, 0, sizeof(Sim));
+    sim->verbose = verbose;
+    sim->wireClockHz = 100000;
+    sim->events = events;
+    snprintf(sim->configReply, sizeof(sim->configReply), "%s", config);
+    sim->slotUs = (uint64_t)(ADAPTIVE_INTERVAL ? INTERVAL_MIN_MS : INTERVAL_MS) * 1000;
+    sim->outageFromUs = (uint64_t)(outageFromH * 3.6e9);
+    sim->outageToUs = (uint64_t)(outageToH * 3.6e9);
+    sim->unplugFromUs = (uint64_t)(unplugFromH * 3.6e9);
+    sim->unplugToUs = (uint64_t)(unplugToH * 3.6e9);
+    sim->stuckBusAtUs = (uint64_t)(stuckBusH * 3.6e9);
+    sim->crashAtUs = (uint64_t)(crashH * 3.6e9);
+
+    snprintf(sim->fsRoot, sizeof(sim->fsRoot), "%s/benchfs.XXXXXX", getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    if (!mkdtemp(sim->fsRoot)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+#if DEEP_SLEEP
+    if (!runDeepSleep(argv[0], fd, intervals)) return 1;
+#else
+    runAlwaysOn(argv[0], fd, intervals);
+#endif
+    return finish(intervals);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <Wire.h>
+
+// Register map and protected members of the real driver that BME280Device
+// relies on. begin() only succeeds at the simulated chips' addresses and
+// loads the calibration example from the datasheet.
+enum {
+    BME280_REGISTER_CHIPID       = 0xD0,
+    BME280_REGISTER_CONTROLHUMID = 0xF2,
+    BME280_REGISTER_STATUS       = 0xF3,
+    BME280_REGISTER_CONTROL      = 0xF4,
+    BME280_REGISTER_CONFIG       = 0xF5,
+    BME280_REGISTER_PRESSUREDATA = 0xF7,
+    BME280_REGISTER_TEMPDATA     = 0xFA,
+    BME280_REGISTER_HUMIDDATA    = 0xFD,
+};
+
+typedef struct {
+    uint16_t dig_T1;
+    int16_t  dig_T2;
+    int16_t  dig_T3;
+    uint16_t dig_P1;
+    int16_t  dig_P2, dig_P3, dig_P4, dig_P5, dig_P6, dig_P7, dig_P8, dig_P9;
+    uint8_t  dig_H1;
+    int16_t  dig_H2;
+    uint8_t  dig_H3;
+    int16_t  dig_H4;
+    int16_t  dig_H5;
+    int8_t   dig_H6;
+} bme280_calib_data;
+
+class Adafruit_BME280 {
+public:
+    enum sensor_sampling { SAMPLING_NONE, SAMPLING_X1, SAMPLING_X2, SAMPLING_X4, SAMPLING_X8, SAMPLING_X16 };
+    enum sensor_mode { MODE_SLEEP = 0, MODE_FORCED = 1, MODE_NORMAL = 3 };
+    enum sensor_filter { FILTER_OFF, FILTER_X2, FILTER_X4, FILTER_X8, FILTER_X16 };
+    enum standby_duration {
+        STANDBY_MS_0_5 = 0, STANDBY_MS_62_5, STANDBY_MS_125, STANDBY_MS_250,
+        STANDBY_MS_500, STANDBY_MS_1000, STANDBY_MS_10, STANDBY_MS_20
+    };
+
+    bool begin(uint8_t addr = 0x77, TwoWire* wire = &Wire) {
+        (void)wire;
+        _i2caddr = addr;
+        if (addr != SimModel::BME280_ADDR && addr != SimModel::BME280_ADDR_ALT) return false;
+        if (!simI2cReachable()) return false;
+        _bme280_calib = { 27504, 26435, -1000, 36477, -10685, 3024, 2855, 140, -7, 15500, -14600, 6000,
+                          75, 362, 0, 321, 50, 30 };
+        return true;
+    }
+
+    void setSampling(sensor_mode mode = MODE_NORMAL, sensor_sampling t = SAMPLING_X16,
+                     sensor_sampling p = SAMPLING_X16, sensor_sampling h = SAMPLING_X16,
+                     sensor_filter f = FILTER_OFF, standby_duration d = STANDBY_MS_0_5) {
+        _measReg.mode = mode;
+        _measReg.osrs_t = t;
+        _measReg.osrs_p = p;
+        _humReg.osrs_h = h;
+        _configReg.filter = f;
+        _configReg.t_sb = d;
+    }
+
+    uint32_t sensorID() { return 0x60; }
+
+protected:
+    struct config {
+        unsigned int t_sb : 3;
+        unsigned int filter : 3;
+        unsigned int none : 1;
+        unsigned int spi3w_en : 1;
+        unsigned int get() { return (t_sb << 5) | (filter << 2) | spi3w_en; }
+    };
+
+    struct ctrl_meas {
+        unsigned int osrs_t : 3;
+        unsigned int osrs_p : 3;
+        unsigned int mode : 2;
+        unsigned int get() { return (osrs_t << 5) | (osrs_p << 2) | mode; }
+    };
+
+    struct ctrl_hum {
+        unsigned int none : 5;
+        unsigned int osrs_h : 3;
+        unsigned int get() { return osrs_h; }
+    };
+
+    // Conversions finish instantly; the firmware's own delay models them.
+    void write8(byte reg, byte value) { (void)reg; (void)value; }
+    uint8_t read8(byte reg) { (void)reg; return 0; }
+
+    uint8_t _i2caddr = 0x77;
+    int32_t _sensorID = 0x60;
+    int32_t t_fine = 0;
+    int32_t t_fine_adjust = 0;
+    bme280_calib_data _bme280_calib = {};
+    config _configReg = {};
+    ctrl_meas _measReg = {};
+    ctrl_hum _humReg = {};
+};
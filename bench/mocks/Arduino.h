@@ -0,0 +1,161 @@
+#pragma once
+
+// Host stand-in for the parts of the ESP8266 Arduino core the firmware
+// uses. Time comes from the simulated clock in sim.h.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <algorithm>
+#include <initializer_list>
+#include "sim.h"
+
+using std::isnan;
+typedef uint8_t byte;
+
+unsigned long millis();
+unsigned long micros();
+uint64_t micros64();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+#define LOW               0x0
+#define HIGH              0x1
+#define INPUT             0x00
+#define OUTPUT            0x01
+#define INPUT_PULLUP      0x02
+#define OUTPUT_OPEN_DRAIN 0x03
+
+// Only the I2C pins are wired up, see simI2cReachable().
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+#define F(s)    (s)
+#define PSTR(s) (s)
+
+class String {
+public:
+    String() {}
+    String(const char* s) : s(s ? s : "") {}
+    String(const std::string& s) : s(s) {}
+    String(int v) : s(std::to_string(v)) {}
+    String(unsigned v) : s(std::to_string(v)) {}
+    String(long v) : s(std::to_string(v)) {}
+    String(unsigned long v) : s(std::to_string(v)) {}
+
+    const char* c_str() const { return s.c_str(); }
+    unsigned length() const   { return (unsigned)s.size(); }
+    bool isEmpty() const      { return s.empty(); }
+    char operator[](unsigned i) const { return i < s.size() ? s[i] : '\0'; }
+
+    int indexOf(char c, unsigned from = 0) const        { return found(s.find(c, from)); }
+    int indexOf(const char* t, unsigned from = 0) const { return found(s.find(t, from)); }
+    bool startsWith(const char* prefix) const           { return s.rfind(prefix, 0) == 0; }
+    bool equals(const char* o) const                    { return s == o; }
+    bool operator==(const char* o) const                { return s == o; }
+    bool operator==(const String& o) const              { return s == o.s; }
+
+    String substring(unsigned from) const { return from < s.size() ? String(s.substr(from)) : String(); }
+    String substring(unsigned from, unsigned to) const {
+        if (from > s.size()) from = (unsigned)s.size();
+        return String(s.substr(from, to > from ? to - from : 0));
+    }
+
+    long toInt() const { return atol(s.c_str()); }
+
+    String& operator+=(const String& o) { s += o.s; return *this; }
+    String& operator+=(const char* o)   { s += o; return *this; }
+    String& operator+=(char c)          { s += c; return *this; }
+    friend String operator+(String a, const String& b) { return a += b; }
+    friend String operator+(String a, const char* b)   { return a += b; }
+
+private:
+    std::string s;
+
+    static int found(size_t pos) { return pos == std::string::npos ? -1 : (int)pos; }
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buf, size_t n) {
+        size_t written = 0;
+        while (n--) written += write(*buf++);
+        return written;
+    }
+    virtual void flush() {}
+
+    size_t print(const char* s)          { return write(reinterpret_cast<const uint8_t*>(s), strlen(s)); }
+    size_t print(const String& s)        { return print(s.c_str()); }
+    size_t print(int v)                  { return print(String(v)); }
+    size_t println(const char* s = "")   { return print(s) + print("\n"); }
+    size_t println(const String& s)      { return println(s.c_str()); }
+    size_t println(int v)                { return println(String(v).c_str()); }
+    size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual int read(uint8_t* buf, size_t n) {
+        size_t i = 0;
+        for (int c; i < n && (c = read()) >= 0; i++) buf[i] = (uint8_t)c;
+        return (int)i;
+    }
+
+    virtual bool hasPeekBufferAPI() const { return false; }
+    virtual size_t peekAvailable()        { return 0; }
+    virtual const char* peekBuffer()      { return nullptr; }
+    virtual void peekConsume(size_t)      {}
+    virtual bool inputCanTimeout()        { return true; }
+
+    size_t readBytes(char* buf, size_t n) { return (size_t)read(reinterpret_cast<uint8_t*>(buf), n); }
+
+    void setTimeout(unsigned long ms) { timeout = ms; }
+
+protected:
+    unsigned long timeout = 1000;
+};
+
+// Output only shows up with --verbose, so benchmark runs stay readable.
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long) {}
+    size_t write(uint8_t c) override { return sim->verbose ? fputc(c, stdout) != EOF : 1; }
+    int available() override         { return 0; }
+    int read() override              { return -1; }
+    int peek() override              { return -1; }
+    using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+class IPAddress {
+public:
+    IPAddress() {}
+    IPAddress(uint32_t v) : v(v) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : v(a | b << 8 | c << 16 | (uint32_t)d << 24) {}
+
+    operator uint32_t() const { return v; }
+    bool isSet() const        { return v != 0; }
+
+    String toString() const {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%u.%u.%u.%u", v & 0xFF, v >> 8 & 0xFF, v >> 16 & 0xFF, v >> 24);
+        return String(buf);
+    }
+
+private:
+    uint32_t v = 0;
+};
+
+#include "Esp.h"
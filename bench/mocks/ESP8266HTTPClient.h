@@ -0,0 +1,64 @@
+#pragma once
+
+#include "ESP8266WiFi.h"
+
+#define HTTPC_ERROR_CONNECTION_FAILED   (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED  (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED       (-4)
+#define HTTPC_ERROR_CONNECTION_LOST     (-5)
+#define HTTPC_ERROR_NO_STREAM           (-6)
+#define HTTPC_ERROR_NO_HTTP_SERVER      (-7)
+#define HTTPC_ERROR_TOO_LESS_RAM        (-8)
+#define HTTPC_ERROR_ENCODING            (-9)
+#define HTTPC_ERROR_STREAM_WRITE        (-10)
+#define HTTPC_ERROR_READ_TIMEOUT        (-11)
+
+#define HTTP_CODE_OK 200
+
+// Sends over the caller's WiFiClient and answers every request with 200
+// after the modeled server time, with Sim::configReply as the body.
+// Without reuse the socket is closed after the response, like the real
+// client.
+class HTTPClient {
+public:
+    bool begin(WiFiClient& c, const String& url) {
+        (void)url;
+        client = &c;
+        return true;
+    }
+
+    bool begin(WiFiClient& c, const String& host, uint16_t port, const String& uri = "/", bool https = false) {
+        (void)host; (void)port; (void)uri; (void)https;
+        client = &c;
+        return true;
+    }
+
+    void end() {
+        if (client && !reuse) client->stop();
+        client = nullptr;
+    }
+
+    void setReuse(bool r)        { reuse = r; }
+    void setTimeout(uint16_t ms) { timeoutMs = ms; }
+    void addHeader(const String& name, const String& value, bool first = false, bool replace = true) {
+        (void)first; (void)replace;
+        headerBytes += name.length() + value.length() + 4;
+    }
+
+    int sendRequest(const char* type, Stream* stream, size_t size = 0);
+    int sendRequest(const char* type, const uint8_t* payload = nullptr, size_t size = 0);
+    int POST(const uint8_t* payload, size_t size) { return sendRequest("POST", payload, size); }
+
+    int getSize() const      { return responseSize; }
+    WiFiClient& getStream()  { return *client; }
+
+    static String errorToString(int code) { return String("HTTP error ") + String(code); }
+
+private:
+    WiFiClient* client = nullptr;
+    bool reuse = false;
+    uint16_t timeoutMs = 5000;
+    size_t headerBytes = 0;
+    int responseSize = 0;
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "Arduino.h"
+#include <functional>
+#include <memory>
+
+enum wl_status_t {
+    WL_IDLE_STATUS     = 0,
+    WL_NO_SSID_AVAIL   = 1,
+    WL_CONNECTED       = 3,
+    WL_CONNECT_FAILED  = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_WRONG_PASSWORD  = 6,
+    WL_DISCONNECTED    = 7,
+};
+
+enum WiFiMode_t { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 };
+enum WiFiSleepType_t { WIFI_NONE_SLEEP = 0, WIFI_LIGHT_SLEEP = 1, WIFI_MODEM_SLEEP = 2 };
+
+struct WiFiEventStationModeGotIP {
+    IPAddress ip;
+    IPAddress mask;
+    IPAddress gw;
+};
+
+struct WiFiEventStationModeDisconnected {
+    String ssid;
+    uint8_t bssid[6];
+    int reason;
+};
+
+struct WiFiEventHandlerOpaque {};
+typedef std::shared_ptr<WiFiEventHandlerOpaque> WiFiEventHandler;
+
+class Client : public Stream {
+public:
+    virtual int connect(IPAddress ip, uint16_t port) = 0;
+    virtual int connect(const char* host, uint16_t port) = 0;
+    virtual uint8_t connected() = 0;
+    virtual void stop() = 0;
+    using Print::write;
+};
+
+// TCP socket to the simulated backend: connecting costs one round trip,
+// data written is delivered at the uplink rate. The only data received is
+// what a mocked server hands over with receive().
+class WiFiClient : public Client {
+public:
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char* host, uint16_t port) override;
+    uint8_t connected() override;
+    void stop() override { open = false; rxLen = 0; }
+
+    size_t write(uint8_t b) override { return write(&b, 1); }
+    size_t write(const uint8_t* buf, size_t n) override;
+    int available() override { return (int)rxLen; }
+    int read() override      { return rxLen ? (rxLen--, (uint8_t)*rx++) : -1; }
+    int peek() override      { return rxLen ? (uint8_t)*rx : -1; }
+
+    void setNoDelay(bool) {}
+
+    // Mock only: makes `n` bytes available to read; they must outlive it.
+    void receive(const char* data, size_t n) { rx = data; rxLen = n; }
+
+private:
+    bool open = false;
+    const char* rx = nullptr;
+    size_t rxLen = 0;
+};
+
+// Station interface with a modeled association: a scan unless a BSSID and
+// channel are given, then association, then DHCP unless a static address
+// was configured. The AP always accepts.
+class ESP8266WiFiClass {
+public:
+    wl_status_t begin(const char* ssid, const char* pass, int32_t channel = 0,
+                      const uint8_t* bssid = nullptr, bool connect = true);
+    wl_status_t status();
+    bool config(IPAddress ip, IPAddress gateway, IPAddress mask, IPAddress dns1 = IPAddress(),
+                IPAddress dns2 = IPAddress());
+    bool disconnect(bool wifiOff = false);
+
+    bool mode(WiFiMode_t m);
+    void persistent(bool) {}
+    bool setAutoReconnect(bool) { return true; }
+    bool setSleepMode(WiFiSleepType_t type, uint8_t listenInterval = 0);
+    bool forceSleepBegin(uint32_t us = 0);
+    bool forceSleepWake();
+
+    int hostByName(const char* host, IPAddress& result, uint32_t timeoutMs = 10000);
+
+    IPAddress localIP()         { return sim->associated ? IPAddress(192, 168, 1, 50) : IPAddress(); }
+    IPAddress gatewayIP()       { return IPAddress(192, 168, 1, 1); }
+    IPAddress subnetMask()      { return IPAddress(255, 255, 255, 0); }
+    IPAddress dnsIP(uint8_t = 0) { return IPAddress(192, 168, 1, 1); }
+    uint8_t* BSSID()            { return bssid; }
+    int32_t channel()           { return 6; }
+    int32_t RSSI()              { return -62; }
+
+    WiFiEventHandler onStationModeGotIP(std::function<void(const WiFiEventStationModeGotIP&)> fn);
+    WiFiEventHandler onStationModeDisconnected(std::function<void(const WiFiEventStationModeDisconnected&)> fn);
+
+private:
+    uint8_t bssid[6] = { 0x02, 0x00, 0x5E, 0x10, 0x20, 0x30 };
+    std::function<void(const WiFiEventStationModeGotIP&)> gotIpFn;
+    std::function<void(const WiFiEventStationModeDisconnected&)> disconnectedFn;
+};
+
+extern ESP8266WiFiClass WiFi;
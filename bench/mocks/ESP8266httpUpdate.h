@@ -0,0 +1,28 @@
+#pragma once
+
+#include "ESP8266WiFi.h"
+
+enum HTTPUpdateResult {
+    HTTP_UPDATE_FAILED,
+    HTTP_UPDATE_NO_UPDATES,
+    HTTP_UPDATE_OK
+};
+typedef HTTPUpdateResult t_httpUpdate_return;
+
+// Update server that is always at FIRMWARE_VERSION: each check is a
+// connect and one request answered with 304.
+class ESP8266HTTPUpdate {
+public:
+    void rebootOnUpdate(bool) {}
+    void setClientTimeout(int) {}
+
+    t_httpUpdate_return update(WiFiClient& client, const String& url, const String& currentVersion = "");
+
+    int getLastError() const       { return lastError; }
+    String getLastErrorString() const { return lastError ? String("connection failed") : String(""); }
+
+private:
+    int lastError = 0;
+};
+
+extern ESP8266HTTPUpdate ESPhttpUpdate;
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Arduino.h"
+
+enum RFMode { RF_DEFAULT = 0, RF_CAL = 1, RF_NO_CAL = 2, RF_DISABLED = 4 };
+
+enum rst_reason {
+    REASON_DEFAULT_RST      = 0,
+    REASON_WDT_RST          = 1,
+    REASON_EXCEPTION_RST    = 2,
+    REASON_SOFT_WDT_RST     = 3,
+    REASON_SOFT_RESTART     = 4,
+    REASON_DEEP_SLEEP_AWAKE = 5,
+    REASON_EXT_SYS_RST      = 6,
+};
+
+struct rst_info {
+    uint32_t reason;
+    uint32_t exccause;
+    uint32_t epc1, epc2, epc3, excvaddr, depc;
+};
+
+enum { WDTO_8S = 8000 };
+
+class EspClass {
+public:
+    // RTC user memory is addressed in 4-byte blocks, 512 bytes in total.
+    bool rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size);
+    bool rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size);
+
+    [[noreturn]] void deepSleep(uint64_t us, RFMode mode = RF_DEFAULT);
+    uint64_t deepSleepMax() { return 0xFFFFFFFFull * 3; }
+    [[noreturn]] void restart();
+
+    uint32_t getFreeHeap();
+    uint16_t getMaxFreeBlockSize();
+    uint32_t getChipId() { return 0x00BE2C; }
+
+    // The simulated chip never hangs.
+    void wdtEnable(uint32_t) {}
+    void wdtFeed() {}
+    rst_info* getResetInfoPtr();
+};
+
+extern EspClass ESP;
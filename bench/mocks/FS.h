@@ -0,0 +1,90 @@
+#pragma once
+
+#include "Arduino.h"
+#include <memory>
+#include <vector>
+
+// Filesystem backed by a host directory (Sim::fsRoot), so its contents
+// outlive a simulated reboot like flash does. Opening a file costs
+// FLASH_OPEN_US and writes FLASH_WRITE_US_PER_BYTE.
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+class File : public Stream {
+public:
+    File() {}
+    explicit File(FILE* fp) : fp(fp, fclose) {}
+
+    explicit operator bool() const { return fp != nullptr; }
+
+    size_t write(uint8_t b) override { return write(&b, 1); }
+    size_t write(const uint8_t* buf, size_t n) override;
+    int read() override;
+    int read(uint8_t* buf, size_t n) override;
+    int peek() override;
+    int available() override { return (int)(size() - position()); }
+    void flush() override    { if (fp) fflush(fp.get()); }
+
+    bool seek(uint32_t pos, SeekMode mode = SeekSet);
+    size_t position() const;
+    size_t size() const;
+    void close() { fp.reset(); }
+    using Print::write;
+
+private:
+    std::shared_ptr<FILE> fp;
+};
+
+class Dir {
+public:
+    bool next();
+    String fileName() const { return String(names[pos - 1].c_str()); }
+    size_t fileSize() const { return sizes[pos - 1]; }
+
+private:
+    friend class FS;
+    std::vector<std::string> names;
+    std::vector<size_t> sizes;
+    size_t pos = 0;
+};
+
+struct FSInfo {
+    size_t totalBytes;
+    size_t usedBytes;
+    size_t blockSize;
+    size_t pageSize;
+    size_t maxOpenFiles;
+    size_t maxPathLength;
+};
+
+class FS {
+public:
+    bool begin();
+    void end() { mounted = false; }
+    bool format();
+    bool info(FSInfo& info);
+
+    File open(const char* path, const char* mode);
+    File open(const String& path, const char* mode) { return open(path.c_str(), mode); }
+    bool exists(const char* path);
+    bool exists(const String& path) { return exists(path.c_str()); }
+    bool remove(const char* path);
+    bool remove(const String& path) { return remove(path.c_str()); }
+    bool rename(const char* from, const char* to);
+    bool mkdir(const char* path);
+    Dir openDir(const char* path);
+
+private:
+    bool mounted = false;
+};
+
+} // namespace fs
+
+using fs::Dir;
+using fs::File;
+using fs::FSInfo;
+using fs::SeekCur;
+using fs::SeekEnd;
+using fs::SeekMode;
+using fs::SeekSet;
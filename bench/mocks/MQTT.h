@@ -0,0 +1,54 @@
+#pragma once
+
+#include "ESP8266WiFi.h"
+#include <functional>
+
+typedef int lwmqtt_err_t;
+typedef int lwmqtt_return_code_t;
+
+class MQTTClient;
+typedef std::function<void(MQTTClient* client, char topic[], char bytes[], int length)> MQTTClientCallbackAdvancedFunction;
+
+// Broker that accepts every session and publish. QoS 1 and 2 cost a
+// round trip for the acknowledgement. It keeps the session across wakes
+// and holds Sim::configReply as a retained message on every topic, which
+// a new subscription receives during the next publish or loop().
+class MQTTClient {
+public:
+    explicit MQTTClient(int bufSize = 128) : bufSize(bufSize) {}
+
+    void begin(const char* h, int p, Client& c) {
+        host = h;
+        port = p;
+        client = &c;
+    }
+
+    void setKeepAlive(int) {}
+    void setCleanSession(bool) {}
+    void setTimeout(int) {}
+
+    bool connect(const char* clientId, bool skip = false) { return connect(clientId, nullptr, nullptr, skip); }
+    bool connect(const char* clientId, const char* user, const char* pass = nullptr, bool skip = false);
+    bool publish(const char* topic, const char* payload, int length, bool retained = false, int qos = 0);
+    bool subscribe(const char* topic, int qos = 0);
+    bool connected()  { return session && client && client->connected(); }
+    bool disconnect() { session = false; if (client) client->stop(); return true; }
+    bool loop()       { deliver(); return connected(); }
+    bool sessionPresent() { return present; }
+    void onMessageAdvanced(MQTTClientCallbackAdvancedFunction cb) { callback = cb; }
+
+    lwmqtt_err_t lastError()          { return 0; }
+    lwmqtt_return_code_t returnCode() { return 0; }
+
+private:
+    int bufSize;
+    const char* host = nullptr;
+    int port = 0;
+    Client* client = nullptr;
+    bool session = false;
+    bool present = false;
+    MQTTClientCallbackAdvancedFunction callback;
+    char retainedTopic[64] = "";
+
+    void deliver();
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "ESP8266WiFi.h"
+
+namespace BearSSL {
+
+// Laid out like br_ssl_session_parameters. The simulated server resumes a
+// session whose id it still has cached.
+class Session {
+public:
+    Session() { memset(this, 0, sizeof(*this)); }
+
+private:
+    friend class WiFiClientSecure;
+    uint8_t sessionId[32];
+    uint8_t sessionIdLen;
+    uint16_t version;
+    uint16_t cipherSuite;
+    uint8_t masterSecret[48];
+};
+
+class PublicKey {
+public:
+    explicit PublicKey(const char* pem) { (void)pem; }
+};
+
+// TLS on top of the simulated socket. A full handshake costs two round
+// trips and the modeled key exchange and signature check, a resumed one a
+// single round trip. The record buffers are allocated on connect and
+// freed on stop, like the real client.
+class WiFiClientSecure : public WiFiClient {
+public:
+    ~WiFiClientSecure() { stop(); }
+
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char* host, uint16_t port) override;
+    void stop() override;
+
+    bool setFingerprint(const char* fp)      { trusted = fp && *fp; return trusted; }
+    void setKnownKey(const PublicKey* key)   { trusted = key != nullptr; }
+    void setBufferSizes(int recv, int xmit)  { rxSize = recv; txSize = xmit; }
+    void setSession(Session* s)              { session = s; }
+
+    static bool probeMaxFragmentLength(IPAddress ip, uint16_t port, uint16_t len);
+
+private:
+    Session* session = nullptr;
+    bool trusted = false;
+    int rxSize = 16709;
+    int txSize = 597;
+    uint8_t* buffers = nullptr;
+};
+
+} // namespace BearSSL
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "ESP8266WiFi.h"
+
+// Datagrams are delivered at the uplink rate. The simulated server does
+// not acknowledge, so UDP_ACK builds always see a timeout. Port 123 is an
+// SNTP server on simulated time, answering one round trip later.
+class WiFiUDP : public Stream {
+public:
+    uint8_t begin(uint16_t port) { (void)port; return 1; }
+    void stop() { replyAtUs = 0; }
+
+    int beginPacket(IPAddress ip, uint16_t port) { (void)ip; return beginPacket("", port); }
+    int beginPacket(const char* host, uint16_t port) { (void)host; toPort = port; pending = 0; return sim->associated; }
+    int endPacket();
+
+    size_t write(uint8_t b) override { return write(&b, 1); }
+    size_t write(const uint8_t* buf, size_t n) override {
+        for (size_t i = 0; i < n && pending + i < sizeof(request); i++) request[pending + i] = buf[i];
+        pending += n;
+        return n;
+    }
+
+    int parsePacket();
+    int available() override                { return (int)(replyLen - replyPos); }
+    int read() override                     { return replyPos < replyLen ? reply[replyPos++] : -1; }
+    int read(uint8_t* buf, size_t n) override {
+        size_t k = 0;
+        for (; k < n && replyPos < replyLen; k++) buf[k] = reply[replyPos++];
+        return (int)k;
+    }
+    int peek() override                     { return replyPos < replyLen ? reply[replyPos] : -1; }
+    IPAddress remoteIP()                    { return replyLen ? IPAddress(10, 0, 0, 1) : IPAddress(); }
+    uint16_t remotePort()                   { return replyLen ? 123 : 0; }
+
+private:
+    static constexpr size_t NTP_SIZE = 48;
+
+    size_t pending = 0;
+    uint16_t toPort = 0;
+    uint8_t request[NTP_SIZE] = {};
+    uint8_t reply[NTP_SIZE] = {};
+    size_t replyLen = 0;
+    size_t replyPos = 0;
+    uint64_t replyAtUs = 0;   // when the pending SNTP answer arrives, 0 for none
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Arduino.h"
+
+// I2C master talking to the simulated BME280s and SHT3x. Transfers cost bus time at
+// the configured clock: 9 bits per byte plus start/stop.
+class TwoWire : public Stream {
+public:
+    void begin() {}
+    void begin(int, int) {}
+    void setClock(uint32_t hz) { sim->wireClockHz = hz; }
+
+    void beginTransmission(uint8_t addr);
+    uint8_t endTransmission(bool sendStop = true);
+    uint8_t requestFrom(uint8_t addr, uint8_t n, bool sendStop = true);
+
+    size_t write(uint8_t b) override;
+    int available() override { return (int)(rxLen - rxPos); }
+    int read() override      { return rxPos < rxLen ? rx[rxPos++] : -1; }
+    int peek() override      { return rxPos < rxLen ? rx[rxPos] : -1; }
+    using Print::write;
+
+private:
+    uint8_t txAddr = 0;
+    uint8_t txLen  = 0;
+    uint8_t reg    = 0;
+    uint8_t rx[32];
+    size_t  rxLen = 0;
+    size_t  rxPos = 0;
+};
+
+extern TwoWire Wire;
@@ -0,0 +1,716 @@
+// Behaviour of the mocked core, driver and network classes against the
+// model in sim.h.
+
+#include <Arduino.h>
+#include <cstdarg>
+#include <coredecls.h>
+#include <Wire.h>
+#include <Adafruit_BME280.h>
+#include <ESP8266WiFi.h>
+#include <ESP8266HTTPClient.h>
+#include <MQTT.h>
+#include <WiFiUdp.h>
+#include <WiFiClientSecure.h>
+#include <ESP8266httpUpdate.h>
+#include <LittleFS.h>
+#include <cerrno>
+#include <dirent.h>
+#include <sys/stat.h>
+
+HardwareSerial Serial;
+EspClass ESP;
+TwoWire Wire;
+ESP8266WiFiClass WiFi;
+fs::FS LittleFS;
+ESP8266HTTPUpdate ESPhttpUpdate;
+
+extern size_t benchLiveBytes();
+
+// --- Time ---------------------------------------------------------------
+
+void simAdvance(uint64_t us, bool idle) {
+    sim->clockUs += us;
+
+    if (!sim->radioOn) return;
+    if (idle && sim->associated && sim->sleepType != WIFI_NONE_SLEEP) {
+        // Modem and light sleep only wake the radio for every
+        // listenInterval-th beacon.
+        uint64_t beacons = SimModel::BEACON_US * (sim->listenInterval ? sim->listenInterval : 1);
+        sim->counters.radioUs += us * SimModel::BEACON_RX_US / beacons;
+    } else {
+        sim->counters.radioUs += us;
+    }
+}
+
+unsigned long millis() { return (unsigned long)((sim->clockUs - sim->bootUs) / 1000); }
+unsigned long micros() { return (unsigned long)(uint32_t)(sim->clockUs - sim->bootUs); }
+uint64_t micros64() { return sim->clockUs - sim->bootUs; }
+void delay(unsigned long ms) { simAdvance((uint64_t)ms * 1000, true); }
+void delayMicroseconds(unsigned int us) { simAdvance(us); }
+void yield() { simAdvance(SimModel::YIELD_US); }
+
+size_t Print::printf(const char* fmt, ...) {
+    char buf[512];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (n < 0) return 0;
+    return write(reinterpret_cast<const uint8_t*>(buf), std::min((size_t)n, sizeof(buf) - 1));
+}
+
+// Same MSB-first CRC-32 as the ESP8266 core.
+uint32_t crc32(const void* data, size_t length, uint32_t crc) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    while (length--) {
+        uint8_t c = *p++;
+        for (uint32_t i = 0x80; i > 0; i >>= 1) {
+            bool bit = crc & 0x80000000;
+            if (c & i) bit = !bit;
+            crc <<= 1;
+            if (bit) crc ^= 0x04c11db7;
+        }
+    }
+    return crc;
+}
+
+// --- ESP ----------------------------------------------------------------
+
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size) {
+    if (offset * 4 + size > sizeof(sim->rtcMemory)) return false;
+    memcpy(data, sim->rtcMemory + offset * 4, size);
+    return true;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size) {
+    if (offset * 4 + size > sizeof(sim->rtcMemory)) return false;
+    memcpy(sim->rtcMemory + offset * 4, data, size);
+    return true;
+}
+
+void EspClass::deepSleep(uint64_t us, RFMode mode) { benchDeepSleep(us, mode == RF_DISABLED); }
+
+rst_info* EspClass::getResetInfoPtr() {
+    static rst_info info;
+    info = rst_info();
+    info.reason = sim->resetReason;
+    return &info;
+}
+void EspClass::restart() { benchDeepSleep(0, false); }
+
+// No fragmentation is modeled, so the largest block is all that is free.
+uint32_t EspClass::getFreeHeap() {
+    size_t live = benchLiveBytes();
+    return live < SimModel::HEAP_BYTES ? SimModel::HEAP_BYTES - (uint32_t)live : 0;
+}
+
+uint16_t EspClass::getMaxFreeBlockSize() {
+    uint32_t free = getFreeHeap();
+    return free > 0xFFFF ? 0xFFFF : (uint16_t)free;
+}
+
+// --- BME280 on I2C ------------------------------------------------------
+
+// Raw ADC values around the datasheet calibration example: temperature
+// swings 1.5 degC and humidity 5 %RH over six hours, pressure 150 Pa over
+// twelve, with a little noise on top. About 3175 LSB per degC, -5.8 LSB
+// per Pa and 180 LSB per %RH.
+static void sensorBlock(uint8_t* out) {
+    static uint32_t rng = 12345;
+    auto noise = [](int32_t amplitude) {
+        rng = rng * 1103515245 + 12345;
+        return (int32_t)((rng >> 16) % (2 * amplitude + 1)) - amplitude;
+    };
+
+    // The first read of a burst is when a sample is taken; how far that is
+    // from the nearest boundary of the Unix-time grid shows the slot
+    // alignment.
+    if (sim->slotUs && (!sim->counters.sensorReads || sim->clockUs - sim->lastSensorReadUs > 1000000)) {
+        uint64_t phase = (SimModel::EPOCH_START_S * 1000000 + sim->clockUs) % sim->slotUs;
+        uint64_t lag = phase < sim->slotUs / 2 ? phase : sim->slotUs - phase;
+        sim->counters.bursts++;
+        sim->counters.slotLagUs += lag;
+        if (lag > sim->counters.slotLagMaxUs) sim->counters.slotLagMaxUs = lag;
+    }
+    sim->lastSensorReadUs = sim->clockUs;
+
+    if (++sim->counters.sensorReads % SimModel::GLITCH_EVERY == 0) {
+        memset(out, 0, 8);
+        return;
+    }
+
+    double hours = sim->clockUs / 3.6e9;
+    double temperature = 21.0 + 1.5 * sin(2 * M_PI * hours / 6);
+    double humidity = 45.0 - 5.0 * sin(2 * M_PI * hours / 6);
+
+    // --events: the heating kicks in every few hours, warming the room by
+    // 2 degC over a quarter of an hour, after which it cools off again.
+    if (sim->events) {
+        double sinceH = fmod(hours, SimModel::EVENT_EVERY_H) - SimModel::EVENT_EVERY_H / 2;
+        double bump = sinceH < 0 ? 0 : sinceH < 0.25 ? sinceH / 0.25 : exp(-(sinceH - 0.25) / 0.5);
+        temperature += 2.0 * bump;
+        humidity -= 4.0 * bump;
+    }
+    double pressure = 100653.0 + 150.0 * sin(2 * M_PI * hours / 12);
+
+    uint32_t adcT = (uint32_t)(519888 + (temperature - 25.08) * 3175) + noise(95);
+    uint32_t adcP = (uint32_t)(415148 - (pressure - 100653.0) * 5.8) + noise(20);
+    uint32_t adcH = (uint32_t)(28800 + (humidity - 45.0) * 180) + noise(30);
+
+    out[0] = adcP >> 12; out[1] = adcP >> 4; out[2] = adcP << 4;
+    out[3] = adcT >> 12; out[4] = adcT >> 4; out[5] = adcT << 4;
+    out[6] = adcH >> 8;  out[7] = adcH;
+}
+
+// --- SHT3x on I2C -------------------------------------------------------
+
+static uint8_t sht3xCrc(const uint8_t* p) {
+    uint8_t crc = 0xFF;
+    for (int n = 0; n < 2; n++) {
+        crc ^= p[n];
+        for (int i = 0; i < 8; i++) crc = crc & 0x80 ? (crc << 1) ^ 0x31 : crc << 1;
+    }
+    return crc;
+}
+
+// Same climate as the BME280, read half a degree warmer as if mounted
+// nearer the board.
+static void sht3xBlock(uint8_t* out) {
+    sim->counters.sensorReads++;
+    double hours = sim->clockUs / 3.6e9;
+    double temperature = 21.5 + 1.5 * sin(2 * M_PI * hours / 6);
+    double humidity = 44.0 - 5.0 * sin(2 * M_PI * hours / 6);
+
+    uint16_t rawT = (uint16_t)((temperature + 45.0) * 65535.0 / 175.0);
+    uint16_t rawH = (uint16_t)(humidity * 65535.0 / 100.0);
+    out[0] = rawT >> 8; out[1] = rawT; out[2] = sht3xCrc(out);
+    out[3] = rawH >> 8; out[4] = rawH; out[5] = sht3xCrc(out + 3);
+}
+
+static bool isBme280(uint8_t addr) { return addr == SimModel::BME280_ADDR || addr == SimModel::BME280_ADDR_ALT; }
+
+// --pipeline drives the sensor classes without a Sim; the bus is fine then.
+static bool busStuck() {
+    return sim && sim->stuckBusAtUs && !sim->busFreed && sim->clockUs >= sim->stuckBusAtUs;
+}
+
+bool simI2cReachable() {
+    if (!sim) return true;
+    bool unplugged = sim->clockUs >= sim->unplugFromUs && sim->clockUs < sim->unplugToUs;
+    return !unplugged && !busStuck();
+}
+
+// --- GPIO ---------------------------------------------------------------
+
+// SCL let go after being pulled low is one clock pulse for a stuck bus.
+void pinMode(uint8_t pin, uint8_t mode) {
+    if (pin == SimModel::SCL_PIN && mode != OUTPUT_OPEN_DRAIN) digitalWrite(pin, HIGH);
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    if (pin != SimModel::SCL_PIN || (value == LOW) == sim->sclLow) return;
+    sim->sclLow = value == LOW;
+    if (sim->sclLow || !busStuck()) return;
+    if (++sim->stuckPulses >= SimModel::STUCK_BUS_PULSES) {
+        sim->busFreed = true;
+        sim->counters.busRecoveries++;
+    }
+}
+
+int digitalRead(uint8_t pin) {
+    if (pin == SimModel::SDA_PIN) return busStuck() ? LOW : HIGH;
+    if (pin == SimModel::SCL_PIN) return sim->sclLow ? LOW : HIGH;
+    return HIGH;
+}
+
+static void busTime(size_t bytes) {
+    uint32_t hz = sim->wireClockHz ? sim->wireClockHz : 100000;
+    simAdvance((bytes * 9 + 2) * 1000000ull / hz);
+}
+
+void TwoWire::beginTransmission(uint8_t addr) {
+    txAddr = addr;
+    txLen = 0;
+}
+
+size_t TwoWire::write(uint8_t b) {
+    if (txLen++ == 0) reg = b;
+    return 1;
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop) {
+    (void)sendStop;
+    busTime(1 + txLen);
+    if (!simI2cReachable()) return 2;   // address NACK
+    return isBme280(txAddr) || txAddr == SimModel::SHT3X_ADDR ? 0 : 2;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t addr, uint8_t n, bool sendStop) {
+    (void)sendStop;
+    rxLen = rxPos = 0;
+    busTime(1 + n);
+    if (n > sizeof(rx)) return 0;
+
+    memset(rx, 0, sizeof(rx));
+    if (!simI2cReachable()) return 0;
+    if (isBme280(addr)) {
+        if (reg == BME280_REGISTER_PRESSUREDATA && n == 8) sensorBlock(rx);
+    } else if (addr == SimModel::SHT3X_ADDR) {
+        if (n == 6) sht3xBlock(rx);
+    } else {
+        return 0;
+    }
+    rxLen = n;
+    return n;
+}
+
+// --- Wi-Fi --------------------------------------------------------------
+
+static bool inOutage() { return sim->clockUs >= sim->outageFromUs && sim->clockUs < sim->outageToUs; }
+
+static bool canTransmit() { return sim->radioOn && sim->associated && !inOutage(); }
+
+wl_status_t ESP8266WiFiClass::begin(const char* ssid, const char* pass, int32_t channel,
+                                    const uint8_t* bssid, bool connect) {
+    (void)ssid; (void)pass;
+    if (!connect) return WL_DISCONNECTED;
+    if (sim->rfDisabled) return WL_DISCONNECTED;
+
+    sim->radioOn = true;
+    sim->associated = false;
+    sim->associating = true;
+    sim->counters.associations++;
+
+    uint64_t us = SimModel::ASSOC_US;
+    if (!(channel && bssid)) us += SimModel::SCAN_US;
+    if (!sim->staticIp) us += SimModel::DHCP_US;
+    sim->associatedAtUs = sim->clockUs + us;
+    return WL_DISCONNECTED;
+}
+
+wl_status_t ESP8266WiFiClass::status() {
+    if (inOutage()) {
+        if (sim->associated) disconnect();
+        if (sim->associating && sim->clockUs >= sim->associatedAtUs) {
+            sim->associating = false;
+            return WL_NO_SSID_AVAIL;
+        }
+        return WL_DISCONNECTED;
+    }
+    if (sim->associating && sim->clockUs >= sim->associatedAtUs) {
+        sim->associating = false;
+        sim->associated = true;
+        if (gotIpFn) gotIpFn(WiFiEventStationModeGotIP{ localIP(), subnetMask(), gatewayIP() });
+    }
+    return sim->associated ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+bool ESP8266WiFiClass::config(IPAddress ip, IPAddress gateway, IPAddress mask, IPAddress dns1, IPAddress dns2) {
+    (void)gateway; (void)mask; (void)dns1; (void)dns2;
+    sim->staticIp = ip.isSet();
+    return true;
+}
+
+bool ESP8266WiFiClass::disconnect(bool wifiOff) {
+    bool was = sim->associated;
+    sim->associated = sim->associating = false;
+    if (wifiOff) sim->radioOn = false;
+    if (was && disconnectedFn) disconnectedFn(WiFiEventStationModeDisconnected{ String(), {}, 8 });
+    return true;
+}
+
+bool ESP8266WiFiClass::mode(WiFiMode_t m) {
+    if (m == WIFI_OFF) {
+        disconnect(true);
+    } else if (!sim->rfDisabled) {
+        sim->radioOn = true;
+    }
+    return true;
+}
+
+bool ESP8266WiFiClass::setSleepMode(WiFiSleepType_t type, uint8_t listenInterval) {
+    sim->sleepType = type;
+    sim->listenInterval = listenInterval;
+    return true;
+}
+
+bool ESP8266WiFiClass::forceSleepBegin(uint32_t us) {
+    (void)us;
+    disconnect(true);
+    return true;
+}
+
+bool ESP8266WiFiClass::forceSleepWake() {
+    if (!sim->rfDisabled) sim->radioOn = true;
+    return true;
+}
+
+int ESP8266WiFiClass::hostByName(const char* host, IPAddress& result, uint32_t timeoutMs) {
+    (void)host;
+    if (!canTransmit()) {
+        simAdvance((uint64_t)timeoutMs * 1000, true);
+        return 0;
+    }
+    simAdvance(SimModel::DNS_US, true);
+    result = IPAddress(10, 0, 0, 1);
+    return 1;
+}
+
+WiFiEventHandler ESP8266WiFiClass::onStationModeGotIP(std::function<void(const WiFiEventStationModeGotIP&)> fn) {
+    gotIpFn = fn;
+    return std::make_shared<WiFiEventHandlerOpaque>();
+}
+
+WiFiEventHandler ESP8266WiFiClass::onStationModeDisconnected(
+    std::function<void(const WiFiEventStationModeDisconnected&)> fn) {
+    disconnectedFn = fn;
+    return std::make_shared<WiFiEventHandlerOpaque>();
+}
+
+// --- TCP, HTTP, MQTT, UDP -----------------------------------------------
+
+int WiFiClient::connect(IPAddress ip, uint16_t port) {
+    (void)ip; (void)port;
+    if (!canTransmit()) return 0;
+    simAdvance(SimModel::RTT_US, true);
+    open = true;
+    return 1;
+}
+
+int WiFiClient::connect(const char* host, uint16_t port) {
+    IPAddress ip;
+    return WiFi.hostByName(host, ip) && connect(ip, port);
+}
+
+uint8_t WiFiClient::connected() {
+    if (!canTransmit()) open = false;
+    return open;
+}
+
+size_t WiFiClient::write(const uint8_t* buf, size_t n) {
+    (void)buf;
+    if (!connected()) return 0;
+    simAdvance(n * SimModel::TX_US_PER_BYTE);
+    return n;
+}
+
+namespace BearSSL {
+
+int WiFiClientSecure::connect(IPAddress ip, uint16_t port) {
+    if (!trusted || !WiFiClient::connect(ip, port)) return 0;
+
+    bool resume = session && session->sessionIdLen && sim->tlsSessionId &&
+                  !memcmp(session->sessionId, &sim->tlsSessionId, sizeof(sim->tlsSessionId)) &&
+                  sim->clockUs - sim->tlsSessionStartUs < SimModel::TLS_SESSION_LIFETIME_US;
+    uint64_t rxUs = (resume ? 200 : 3200) * SimModel::TX_US_PER_BYTE;   // server flight, certificate chain
+    simAdvance((resume ? 1 : 2) * SimModel::RTT_US + rxUs, true);
+    simAdvance(resume ? SimModel::TLS_RESUME_CPU_US : SimModel::TLS_FULL_CPU_US);
+    if (!WiFiClient::connected()) return 0;
+
+    buffers = new uint8_t[rxSize + txSize];
+    if (resume) {
+        sim->counters.tlsResumed++;
+    } else {
+        sim->counters.tlsFullHandshakes++;
+        sim->tlsSessionId++;
+        sim->tlsSessionStartUs = sim->clockUs;
+        if (session) {
+            *session = Session();
+            memcpy(session->sessionId, &sim->tlsSessionId, sizeof(sim->tlsSessionId));
+            session->sessionIdLen = 32;
+            session->version = 0x0303;
+            session->cipherSuite = 0xC02F;
+        }
+    }
+    return 1;
+}
+
+int WiFiClientSecure::connect(const char* host, uint16_t port) {
+    IPAddress ip;
+    return WiFi.hostByName(host, ip) && connect(ip, port);
+}
+
+void WiFiClientSecure::stop() {
+    WiFiClient::stop();
+    delete[] buffers;
+    buffers = nullptr;
+}
+
+// The server takes any fragment length: one connect and a hello exchange.
+bool WiFiClientSecure::probeMaxFragmentLength(IPAddress ip, uint16_t port, uint16_t len) {
+    (void)len;
+    WiFiClient probe;
+    if (!probe.connect(ip, port)) return false;
+    simAdvance(SimModel::RTT_US + 200 * SimModel::TX_US_PER_BYTE, true);
+    probe.stop();
+    return true;
+}
+
+} // namespace BearSSL
+
+// After a --crash reset, the backend checks the JSON uploads: the first
+// one has to count the reset, and no row may be older than the run, which
+// it would be after the device clock went back.
+static void inspectUpload(const std::string& body) {
+    if (body.empty() || body[0] != '{') return;
+    if (!sim->uploadsAfterCrash++) {
+        const char* crashes = strstr(body.c_str(), "\"crash_resets\":");
+        sim->crashReported = crashes && atoi(crashes + 15) > 0;
+    }
+
+    const char* rows = strstr(body.c_str(), "\"readings\":[");
+    if (!rows || !strstr(body.c_str(), "\"fields\":[\"age\"")) return;
+    uint64_t runSec = sim->clockUs / 1000000;
+    for (const char* p = rows + 12; *p == '['; ) {
+        if (strtoull(p + 1, nullptr, 10) > runSec) sim->badAges++;
+        p = strchr(p, ']');
+        if (!p || *++p != ',') break;
+        p++;
+    }
+}
+
+int HTTPClient::sendRequest(const char* type, Stream* stream, size_t size) {
+    (void)type;
+    if (!client || !client->connected()) return HTTPC_ERROR_NOT_CONNECTED;
+
+    // Headers first, then the body the way the core drains it: through
+    // the peek buffer in chunks of at most one TCP segment.
+    simAdvance((128 + headerBytes) * SimModel::TX_US_PER_BYTE);
+    size_t sent = 0;
+    std::string body;
+    if (stream->hasPeekBufferAPI()) {
+        while (size_t n = std::min(stream->peekAvailable(), (size_t)1460)) {
+            simAdvance(n * SimModel::TX_US_PER_BYTE);
+            if (sim->crashed) body.append(stream->peekBuffer(), n);
+            stream->peekConsume(n);
+            sent += n;
+        }
+    } else {
+        for (int c; (c = stream->read()) >= 0; sent++) {
+            simAdvance(SimModel::TX_US_PER_BYTE);
+            if (sim->crashed) body += (char)c;
+        }
+    }
+    if (size && sent != size) return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+
+    simAdvance(SimModel::RTT_US + SimModel::SERVER_US, true);
+    sim->counters.requests++;
+    sim->counters.bytesSent += sent;
+    if (sim->crashed) inspectUpload(body);
+
+    responseSize = (int)strlen(sim->configReply);
+    if (responseSize) {
+        simAdvance(responseSize * SimModel::TX_US_PER_BYTE);
+        client->receive(sim->configReply, responseSize);
+        sim->counters.configReplies++;
+    }
+
+    if (!reuse) client->stop();
+    return 200;
+}
+
+int HTTPClient::sendRequest(const char* type, const uint8_t* payload, size_t size) {
+    struct Buffer : Stream {
+        const uint8_t* p;
+        size_t n;
+        Buffer(const uint8_t* p, size_t n) : p(p), n(n) {}
+        int available() override { return (int)n; }
+        int read() override      { return n ? (n--, *p++) : -1; }
+        int peek() override      { return n ? *p : -1; }
+        size_t write(uint8_t) override { return 0; }
+    } body(payload, payload ? size : 0);
+    return sendRequest(type, &body, size);
+}
+
+bool MQTTClient::connect(const char* clientId, const char* user, const char* pass, bool skip) {
+    (void)clientId; (void)user; (void)pass; (void)skip;
+    if (!client || (!client->connected() && !client->connect(host, (uint16_t)port))) return false;
+    simAdvance(SimModel::RTT_US, true);   // CONNECT / CONNACK
+    session = true;
+    present = sim->mqttSession;
+    sim->mqttSession = true;
+    return true;
+}
+
+bool MQTTClient::subscribe(const char* topic, int qos) {
+    (void)qos;
+    if (!connected()) return false;
+    simAdvance((strlen(topic) + 8) * SimModel::TX_US_PER_BYTE + SimModel::RTT_US, true);   // SUBSCRIBE / SUBACK
+    if (sim->configReply[0]) snprintf(retainedTopic, sizeof(retainedTopic), "%s", topic);
+    return true;
+}
+
+void MQTTClient::deliver() {
+    if (!retainedTopic[0] || !connected()) return;
+    char message[sizeof(sim->configReply)];
+    int length = (int)strlen(sim->configReply);
+    memcpy(message, sim->configReply, length);
+    simAdvance((strlen(retainedTopic) + length + 8) * SimModel::TX_US_PER_BYTE);
+    sim->counters.configReplies++;
+    if (callback) callback(this, retainedTopic, message, length);
+    retainedTopic[0] = '\0';
+}
+
+bool MQTTClient::publish(const char* topic, const char* payload, int length, bool retained, int qos) {
+    (void)payload; (void)retained;
+    if (!connected() || length + (int)strlen(topic) + 8 > bufSize) return false;
+    simAdvance((strlen(topic) + length + 8) * SimModel::TX_US_PER_BYTE);
+    if (qos > 0) simAdvance(SimModel::RTT_US, true);
+    sim->counters.requests++;
+    sim->counters.bytesSent += length;
+    if (qos > 0) deliver();
+    return true;
+}
+
+t_httpUpdate_return ESP8266HTTPUpdate::update(WiFiClient& client, const String& url, const String& currentVersion) {
+    (void)url; (void)currentVersion;
+    sim->counters.otaChecks++;
+    IPAddress ip;
+    if (!WiFi.hostByName("ota", ip) || !client.connect(ip, 80)) {
+        lastError = -1;
+        return HTTP_UPDATE_FAILED;
+    }
+    simAdvance(200 * SimModel::TX_US_PER_BYTE + SimModel::RTT_US + SimModel::SERVER_US, true);
+    client.stop();
+    lastError = 0;
+    return HTTP_UPDATE_NO_UPDATES;
+}
+
+int WiFiUDP::endPacket() {
+    if (!canTransmit()) return 0;
+    simAdvance((pending + 28) * SimModel::TX_US_PER_BYTE);
+    if (toPort == 123) {
+        if (pending == NTP_SIZE) {
+            sim->counters.ntpQueries++;
+            replyAtUs = sim->clockUs + SimModel::RTT_US;
+        }
+        return 1;
+    }
+    sim->counters.requests++;
+    sim->counters.bytesSent += pending;
+    return 1;
+}
+
+static void putBe32(uint8_t* p, uint32_t v) {
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+// A stratum 2 server whose clock is the simulated one, stamped halfway
+// through the round trip. Our transmit timestamp comes back as originate.
+int WiFiUDP::parsePacket() {
+    replyLen = replyPos = 0;
+    if (!replyAtUs || sim->clockUs < replyAtUs) return 0;
+
+    uint64_t serverUs = SimModel::EPOCH_START_S * 1000000 + sim->clockUs - SimModel::RTT_US / 2;
+    memset(reply, 0, sizeof(reply));
+    reply[0] = 0x24;   // no leap warning, version 4, mode 4 (server)
+    reply[1] = 2;
+    memcpy(reply + 24, request + 40, 8);
+    putBe32(reply + 40, (uint32_t)(serverUs / 1000000 + 2208988800ull));
+    putBe32(reply + 44, (uint32_t)(((serverUs % 1000000) << 32) / 1000000));
+    memcpy(reply + 32, reply + 40, 8);
+    replyAtUs = 0;
+    replyLen = sizeof(reply);
+    return (int)replyLen;
+}
+
+// --- LittleFS -----------------------------------------------------------
+
+namespace fs {
+
+static std::string hostPath(const char* path) { return std::string(sim->fsRoot) + path; }
+
+size_t File::write(const uint8_t* buf, size_t n) {
+    if (!fp) return 0;
+    simAdvance(n * SimModel::FLASH_WRITE_US_PER_BYTE);
+    return fwrite(buf, 1, n, fp.get());
+}
+
+int File::read() {
+    uint8_t b;
+    return read(&b, 1) == 1 ? b : -1;
+}
+
+int File::read(uint8_t* buf, size_t n) { return fp ? (int)fread(buf, 1, n, fp.get()) : -1; }
+
+int File::peek() {
+    if (!fp) return -1;
+    int c = fgetc(fp.get());
+    if (c != EOF) ungetc(c, fp.get());
+    return c == EOF ? -1 : c;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+    static const int whence[] = { SEEK_SET, SEEK_CUR, SEEK_END };
+    return fp && fseek(fp.get(), pos, whence[mode]) == 0;
+}
+
+size_t File::position() const { return fp ? (size_t)ftell(fp.get()) : 0; }
+
+size_t File::size() const {
+    if (!fp) return 0;
+    fflush(fp.get());
+    struct stat st;
+    return fstat(fileno(fp.get()), &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+bool Dir::next() { return pos < names.size() && ++pos; }
+
+bool FS::begin() {
+    if (!mounted) simAdvance(SimModel::FS_MOUNT_US);
+    mounted = true;
+    return true;
+}
+
+bool FS::format() {
+    std::string cmd = std::string("rm -rf '") + sim->fsRoot + "'/*";
+    return system(cmd.c_str()) == 0;
+}
+
+bool FS::info(FSInfo& info) {
+    info = FSInfo{ SimModel::FS_BYTES, 0, 4096, 256, 5, 32 };
+    return mounted;
+}
+
+File FS::open(const char* path, const char* mode) {
+    if (!mounted) return File();
+    simAdvance(SimModel::FLASH_OPEN_US);
+    const char* hostMode = !strcmp(mode, "r") ? "rb" : !strcmp(mode, "w") ? "wb" : !strcmp(mode, "a") ? "ab" : "r+b";
+    FILE* fp = fopen(hostPath(path).c_str(), hostMode);
+    return fp ? File(fp) : File();
+}
+
+bool FS::exists(const char* path) {
+    struct stat st;
+    return mounted && stat(hostPath(path).c_str(), &st) == 0;
+}
+
+bool FS::remove(const char* path) {
+    if (!mounted) return false;
+    simAdvance(SimModel::FLASH_OPEN_US);
+    return ::remove(hostPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char* from, const char* to) {
+    return mounted && ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+bool FS::mkdir(const char* path) { return mounted && (::mkdir(hostPath(path).c_str(), 0755) == 0 || errno == EEXIST); }
+
+Dir FS::openDir(const char* path) {
+    Dir dir;
+    DIR* d = mounted ? opendir(hostPath(path).c_str()) : nullptr;
+    if (!d) return dir;
+    while (dirent* e = readdir(d)) {
+        if (e->d_name[0] == '.') continue;
+        struct stat st;
+        std::string full = hostPath(path) + "/" + e->d_name;
+        if (stat(full.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        dir.names.push_back(e->d_name);
+        dir.sizes.push_back((size_t)st.st_size);
+    }
+    closedir(d);
+    return dir;
+}
+
+} // namespace fs
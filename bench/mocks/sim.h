@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// Timing and power model behind the mocks. Figures are typical for an
+// ESP-12E on a home AP and only need to be plausible relative to each
+// other; the benchmark compares modes, it does not predict battery life.
+struct SimModel {
+    static constexpr uint64_t SCAN_US        = 1800000;  // active scan of all channels
+    static constexpr uint64_t ASSOC_US       = 120000;   // auth, association, 4-way handshake
+    static constexpr uint64_t DHCP_US        = 600000;
+    static constexpr uint64_t DNS_US         = 30000;
+    static constexpr uint64_t RTT_US         = 20000;    // round trip to the backend
+    static constexpr uint64_t SERVER_US      = 60000;    // backend processing per request
+    static constexpr uint64_t TX_US_PER_BYTE = 8;        // ~1 Mbit/s effective uplink
+    static constexpr uint64_t RF_CAL_US      = 5000;     // RF calibration on a radio-enabled wake
+    static constexpr uint64_t BEACON_US      = 102400;   // one beacon interval (100 TU)
+    static constexpr uint64_t BEACON_RX_US   = 3000;     // radio on per beacon heard in modem sleep
+    static constexpr uint64_t YIELD_US       = 1000;     // one pass of a spinning loop()
+    static constexpr uint64_t FS_MOUNT_US    = 20000;    // LittleFS mount
+    static constexpr uint64_t FLASH_OPEN_US   = 1000;     // open or remove a file
+    static constexpr uint64_t FLASH_WRITE_US_PER_BYTE = 3; // ~0.8 ms per 256-byte page
+    static constexpr uint32_t FS_BYTES       = 1 << 20;  // LittleFS partition size
+    static constexpr uint32_t HEAP_BYTES     = 40000;    // free heap with nothing allocated
+    static constexpr uint8_t  BME280_ADDR    = 0x76;
+    static constexpr uint8_t  BME280_ADDR_ALT = 0x77;   // second chip, SDO pulled high
+    static constexpr uint8_t  SHT3X_ADDR     = 0x44;
+    static constexpr uint32_t GLITCH_EVERY   = 97;       // every n-th sensor read is a zeroed block
+    static constexpr uint8_t  SDA_PIN        = 4;
+    static constexpr uint8_t  SCL_PIN        = 5;
+    static constexpr uint32_t STUCK_BUS_PULSES = 5;      // --stuck-bus: clocks until SDA is let go
+    static constexpr uint64_t EPOCH_START_S  = 1767226834; // Unix time at the start of a run, off any slot
+    static constexpr int32_t  SLEEP_DRIFT_PPM = 15000;  // the deep-sleep timer runs 1.5 % long
+    static constexpr double   EVENT_EVERY_H  = 4;        // --events: one heating burst per period
+    static constexpr uint64_t TLS_FULL_CPU_US   = 1100000; // ECDHE P-256 and an RSA-2048 signature at 80 MHz
+    static constexpr uint64_t TLS_RESUME_CPU_US = 15000;   // hashes and key schedule only
+    static constexpr uint64_t TLS_SESSION_LIFETIME_US = 24 * 3600000000ull; // server session cache
+};
+
+// Per-run totals, summed over every wake.
+struct SimCounters {
+    uint64_t cpuNs;          // host time spent inside setup() and loop()
+    uint64_t allocs;         // operator new calls made by the firmware
+    uint64_t allocBytes;
+    uint64_t awakeUs;        // simulated time outside deep sleep
+    uint64_t radioUs;        // modeled radio-on time
+    uint32_t wakes;
+    uint32_t radioWakes;     // wakes that booted with the RF enabled
+    uint32_t associations;
+    uint32_t requests;       // HTTP requests, MQTT publishes or datagrams delivered
+    uint64_t bytesSent;      // payload bytes that reached the backend
+    uint32_t sensorReads;    // I2C burst reads of the data block
+    uint32_t bursts;         // sensor reads more than a second after the previous one
+    uint64_t slotLagUs;      // summed over bursts: distance to the nearest INTERVAL_MS boundary
+    uint64_t slotLagMaxUs;
+    uint32_t ntpQueries;
+    uint32_t tlsFullHandshakes;
+    uint32_t tlsResumed;
+    uint32_t configReplies;  // responses or MQTT messages that carried Sim::configReply
+    uint32_t otaChecks;
+    uint32_t busRecoveries;  // stuck buses the firmware clocked free
+};
+
+// Simulated hardware state. It is placed in shared memory so each
+// deep-sleep wake can run as a fresh process, like a real reboot, and
+// still hand the clock, RTC memory and counters back to the harness.
+struct Sim {
+    uint64_t clockUs;        // simulated time since the run started
+    uint64_t bootUs;         // clockUs when the current boot started
+    uint8_t  rtcMemory[512];
+    bool     rfDisabled;     // the current wake started with RF_DISABLED
+    bool     verbose;        // pass the firmware's Serial output through
+    bool     countAllocs;
+    bool     events;         // add heating bursts to the sensor signal
+    SimCounters counters;
+
+    // Radio
+    bool     radioOn;
+    bool     associated;
+    bool     associating;
+    uint64_t associatedAtUs; // when the pending association completes
+    int      sleepType;      // WiFiSleepType_t requested by the firmware
+    uint8_t  listenInterval;
+    bool     staticIp;
+
+    // Access point unreachable in [outageFromUs, outageToUs)
+    uint64_t outageFromUs;
+    uint64_t outageToUs;
+
+    // Sensor
+    uint32_t wireClockHz;
+    uint64_t unplugFromUs;   // every sensor gone in [unplugFromUs, unplugToUs)
+    uint64_t unplugToUs;
+    uint64_t stuckBusAtUs;   // SDA held low from then until clocked free, 0 for never
+    uint32_t stuckPulses;
+    bool     busFreed;
+    bool     sclLow;
+    uint64_t lastSensorReadUs;
+    uint64_t slotUs;         // INTERVAL_MS, for the slot lag
+
+    // Watchdog reset at crashAtUs (--crash), 0 for never, and what the
+    // backend made of the JSON uploads after it
+    uint64_t crashAtUs;
+    bool     crashed;
+    bool     crashReported;  // the first upload after the reset counted it
+    uint32_t uploadsAfterCrash;
+    uint32_t badAges;        // rows after the reset older than the run
+    uint32_t resetReason;    // rst_info::reason of the current boot
+
+    // Backend TLS session cache: the one session it keeps, 0 for none
+    uint32_t tlsSessionId;
+    uint64_t tlsSessionStartUs;
+
+    // Backend config push: the body of every HTTP response and the
+    // retained MQTT message (--config), and whether the broker holds a
+    // session for the node
+    char     configReply[192];
+    bool     mqttSession;
+
+    char fsRoot[128];        // host directory holding the flash filesystem
+};
+
+extern Sim* sim;
+
+// Whether a sensor can answer on the I2C bus right now.
+bool simI2cReachable();
+
+// Moves the simulated clock forward and charges the radio. `idle` marks
+// time spent waiting in delay(), which modem and light sleep can use to
+// power the radio down between beacons.
+void simAdvance(uint64_t us, bool idle = false);
+
+// Provided by the harness: ends the current wake.
+[[noreturn]] void benchDeepSleep(uint64_t sleepUs, bool rfDisabled);
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <Adafruit_BME280.h>
+#include "main.h"
+#include "channels.h"
+
+// Thin layer over the Adafruit driver that reads the whole data block
+// (0xF7..0xFE) in one I2C transaction and compensates it with the
+// calibration the library already loaded in begin().
+class BME280Device : public Adafruit_BME280 {
+public:
+    struct RawReading {
+        int32_t pressure;
+        int32_t temperature;
+        int32_t humidity;
+    };
+
+    static constexpr sensor_sampling samplingFor(int factor) {
+        return factor >= 16 ? SAMPLING_X16 :
+               factor >= 8  ? SAMPLING_X8  :
+               factor >= 4  ? SAMPLING_X4  :
+               factor >= 2  ? SAMPLING_X2  :
+               factor >= 1  ? SAMPLING_X1  : SAMPLING_NONE;
+    }
+
+    static constexpr sensor_filter filterFor(int coeff) {
+        return coeff >= 16 ? FILTER_X16 :
+               coeff >= 8  ? FILTER_X8  :
+               coeff >= 4  ? FILTER_X4  :
+               coeff >= 2  ? FILTER_X2  : FILTER_OFF;
+    }
+
+    // Datasheet 9.1, maximum measurement time for the given oversampling.
+    static constexpr uint32_t measurementTimeUs(int osrsT, int osrsP, int osrsH) {
+        return 1250 + 2300 * osrsT +
+               (osrsP ? 2300 * osrsP + 575 : 0) +
+               (osrsH ? 2300 * osrsH + 575 : 0);
+    }
+
+    // Starts a single conversion with the ctrl_meas value set up by
+    // setSampling(MODE_FORCED, ...).
+    void startForced() { write8(BME280_REGISTER_CONTROL, _measReg.get()); }
+
+    // Gives a conversion that overran the datasheet time up to 10 ms more.
+    bool waitForced() {
+        for (uint8_t i = 0; i < 10 && (read8(BME280_REGISTER_STATUS) & 0x08); i++) delay(1);
+        return !(read8(BME280_REGISTER_STATUS) & 0x08);
+    }
+
+    bool readRaw(uint8_t addr, RawReading& raw) {
+        uint8_t buf[8];
+
+        Wire.beginTransmission(addr);
+        Wire.write((uint8_t)BME280_REGISTER_PRESSUREDATA);
+        if (Wire.endTransmission(false) != 0) return false;
+        if (Wire.requestFrom(addr, (uint8_t)sizeof(buf)) != sizeof(buf)) return false;
+        for (uint8_t& b : buf) b = Wire.read();
+
+        raw.pressure    = ((uint32_t)buf[0] << 12) | ((uint32_t)buf[1] << 4) | (buf[2] >> 4);
+        raw.temperature = ((uint32_t)buf[3] << 12) | ((uint32_t)buf[4] << 4) | (buf[5] >> 4);
+        raw.humidity    = ((uint32_t)buf[6] << 8) | buf[7];
+        return true;
+    }
+
+    // Datasheet 4.2.3: returns 0.01 degC and updates t_fine for the other channels.
+    int32_t compensateTemperature(int32_t adcT) {
+        const bme280_calib_data& c = _bme280_calib;
+        int32_t var1 = ((((adcT >> 3) - ((int32_t)c.dig_T1 << 1))) * ((int32_t)c.dig_T2)) >> 11;
+        int32_t var2 = (((((adcT >> 4) - ((int32_t)c.dig_T1)) * ((adcT >> 4) - ((int32_t)c.dig_T1))) >> 12) *
+                        ((int32_t)c.dig_T3)) >> 14;
+        t_fine = var1 + var2 + t_fine_adjust;
+        return (t_fine * 5 + 128) >> 8;
+    }
+
+    // Returns Pa in Q24.8, or 0 if the calibration would divide by zero.
+    uint32_t compensatePressure(int32_t adcP) const {
+        const bme280_calib_data& c = _bme280_calib;
+        int64_t var1 = ((int64_t)t_fine) - 128000;
+        int64_t var2 = var1 * var1 * (int64_t)c.dig_P6;
+        var2 = var2 + ((var1 * (int64_t)c.dig_P5) << 17);
+        var2 = var2 + (((int64_t)c.dig_P4) << 35);
+        var1 = ((var1 * var1 * (int64_t)c.dig_P3) >> 8) + ((var1 * (int64_t)c.dig_P2) << 12);
+        var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)c.dig_P1) >> 33;
+        if (var1 == 0) return 0;
+
+        int64_t p = 1048576 - adcP;
+        p = (((p << 31) - var2) * 3125) / var1;
+        var1 = (((int64_t)c.dig_P9) * (p >> 13) * (p >> 13)) >> 25;
+        var2 = (((int64_t)c.dig_P8) * p) >> 19;
+        p = ((p + var1 + var2) >> 8) + (((int64_t)c.dig_P7) << 4);
+        return (uint32_t)p;
+    }
+
+    // Returns %RH in Q22.10.
+    uint32_t compensateHumidity(int32_t adcH) const {
+        const bme280_calib_data& c = _bme280_calib;
+        int32_t v = t_fine - ((int32_t)76800);
+        v = (((((adcH << 14) - (((int32_t)c.dig_H4) << 20) - (((int32_t)c.dig_H5) * v)) + ((int32_t)16384)) >> 15) *
+             (((((((v * ((int32_t)c.dig_H6)) >> 10) * (((v * ((int32_t)c.dig_H3)) >> 11) + ((int32_t)32768))) >> 10) +
+                ((int32_t)2097152)) * ((int32_t)c.dig_H2) + 8192) >> 14));
+        v = (v - (((((v >> 15) * (v >> 15)) >> 7) * ((int32_t)c.dig_H1)) >> 4));
+        v = (v < 0) ? 0 : v;
+        v = (v > 419430400) ? 419430400 : v;
+        return (uint32_t)(v >> 12);
+    }
+};
+
+// Temperature, humidity and pressure from one BME280. With `probeAlternate`
+// a chip that does not answer at `addr` is looked for at the other
+// address, so a single sensor works whichever way SDO is strapped.
+class BME280Sensor {
+public:
+    BME280Sensor(uint8_t addr, bool probeAlternate = false) : addr(addr), probeAlternate(probeAlternate) {
+        setId();
+    }
+
+    // BME280 operating range; the pressure floor also catches the 0 Pa the
+    // compensation returns for a zeroed calibration block.
+    static constexpr uint8_t CHANNEL_COUNT = 3;
+    static constexpr ChannelInfo CHANNELS[CHANNEL_COUNT] = {
+        { "temperature", Quantity::TEMPERATURE, { -40.0f, 85.0f } },
+        { "humidity",    Quantity::HUMIDITY,    { 0.0f, 100.0f } },
+        { "pressure",    Quantity::PRESSURE,    { 30000.0f, 110000.0f } },
+    };
+
+    const char* id() const { return idBuf; }
+
+    bool begin() {
+        if (!bme.begin(addr)) {
+            if (!probeAlternate) return false;
+            addr = addr == 0x76 ? 0x77 : 0x76;
+            if (!bme.begin(addr)) return false;
+            setId();
+        }
+
+        bme.setSampling(FORCED_MODE ? Adafruit_BME280::MODE_FORCED : Adafruit_BME280::MODE_NORMAL,
+                        BME280Device::samplingFor(OVERSAMPLING_TEMP),
+                        BME280Device::samplingFor(OVERSAMPLING_PRES),
+                        BME280Device::samplingFor(OVERSAMPLING_HUM),
+                        BME280Device::filterFor(IIR_COEFF));
+        return true;
+    }
+
+    // In forced mode the chip's own oversampling and IIR filter replace
+    // the software loop: one conversion, one read.
+    uint32_t start() {
+        if (!FORCED_MODE) return 0;
+        bme.startForced();
+        return MEASUREMENT_TIME_US;
+    }
+
+    // One burst read of the whole data block feeds all three channels.
+    bool read(SensorValue* values) {
+        BME280Device::RawReading raw;
+        if (FORCED_MODE && !bme.waitForced()) return false;
+        if (!bme.readRaw(addr, raw)) return false;
+        convert(bme, raw, values);
+        return true;
+    }
+
+    // Compensates one data block into degC, %RH and Pa. 0x80000 / 0x8000
+    // mark a channel the chip skipped. Temperature also calibrates the
+    // other two channels, so an implausible one voids the whole reading.
+    static void convert(BME280Device& bme, const BME280Device::RawReading& raw, float* values) {
+        if (raw.temperature == 0x80000) return;
+        values[0] = bme.compensateTemperature(raw.temperature) / 100.0f;
+        if (!CHANNELS[0].range.contains(values[0])) return;
+
+        if (raw.humidity != 0x8000) values[1] = bme.compensateHumidity(raw.humidity) / 1024.0f;
+        if (raw.pressure != 0x80000) values[2] = bme.compensatePressure(raw.pressure) / 256.0f;
+    }
+
+    // The same in 0.01 degC, 0.01 %RH and Pa, straight from the datasheet's
+    // fixed-point results.
+    static void convert(BME280Device& bme, const BME280Device::RawReading& raw, int32_t* values) {
+        if (raw.temperature == 0x80000) return;
+        values[0] = bme.compensateTemperature(raw.temperature);
+        if (values[0] < TEMP_MIN || values[0] > TEMP_MAX) return;
+
+        if (raw.humidity != 0x8000) values[1] = (int32_t)((bme.compensateHumidity(raw.humidity) * 100 + 512) >> 10);
+        if (raw.pressure != 0x80000) values[2] = (int32_t)((bme.compensatePressure(raw.pressure) + 128) >> 8);
+    }
+
+private:
+    static constexpr int32_t TEMP_MIN = storedBound(CHANNELS[0].range.lo, Quantity::TEMPERATURE);
+    static constexpr int32_t TEMP_MAX = storedBound(CHANNELS[0].range.hi, Quantity::TEMPERATURE);
+    static constexpr uint32_t MEASUREMENT_TIME_US =
+        BME280Device::measurementTimeUs(OVERSAMPLING_TEMP, OVERSAMPLING_PRES, OVERSAMPLING_HUM);
+
+    BME280Device bme;
+    uint8_t addr;
+    bool probeAlternate;
+    char idBuf[10];
+
+    void setId() { snprintf(idBuf, sizeof(idBuf), "bme280_%02x", addr); }
+};
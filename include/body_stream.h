@@ -0,0 +1,115 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Produces a request body piece by piece. fill() writes the next piece
+// into the window and returns its length, 0 once the body is complete;
+// rewind() starts the body over.
+class BodySource {
+public:
+    virtual void rewind() = 0;
+    virtual size_t fill(uint8_t* window, size_t capacity) = 0;
+
+protected:
+    ~BodySource() {}
+};
+
+// Read-only Stream over a body generated into a small fixed window, so an
+// upload needs the same RAM whatever the record count. measure() walks the
+// source once up front to get the length for Content-Length. It exposes
+// the peek-buffer API so the core copies straight from the window into
+// the socket, and records when the last byte was handed over, which marks
+// the end of the request write.
+class BodyStream : public Stream {
+public:
+    BodyStream(BodySource& source, uint8_t* window, size_t windowSize)
+        : source(source), window(window), windowSize(windowSize) {}
+
+    size_t measure() {
+        source.rewind();
+        size_t total = 0;
+        while (size_t n = source.fill(window, windowSize)) total += n;
+        len = total;
+        rewind();
+        return len;
+    }
+
+    // Restarts the body, for a retry on a fresh connection.
+    void rewind() {
+        source.rewind();
+        winPos = winLen = 0;
+        pos = 0;
+        drainedAt = 0;
+    }
+
+    size_t length() const        { return len; }
+    bool drained() const         { return pos == len; }
+    uint32_t drainedAtUs() const { return drainedAt; }
+
+    // Copies the rest of the body into `out`; returns the bytes written.
+    size_t writeTo(Print& out) {
+        size_t total = 0;
+        while (size_t n = peekAvailable()) {
+            size_t w = out.write(window + winPos, n);
+            consume(w);
+            total += w;
+            if (w != n) break;
+        }
+        return total;
+    }
+
+    int available() override { return (int)peekAvailable(); }
+    int peek() override      { return peekAvailable() ? window[winPos] : -1; }
+
+    int read() override {
+        if (!peekAvailable()) return -1;
+        uint8_t c = window[winPos];
+        consume(1);
+        return c;
+    }
+
+    int read(uint8_t* buf, size_t n) override {
+        size_t done = 0;
+        while (done < n) {
+            size_t avail = peekAvailable();
+            if (!avail) break;
+            size_t take = avail < n - done ? avail : n - done;
+            memcpy(buf + done, window + winPos, take);
+            consume(take);
+            done += take;
+        }
+        return (int)done;
+    }
+
+    size_t write(uint8_t) override { return 0; }
+
+    bool hasPeekBufferAPI() const override { return true; }
+    const char* peekBuffer() override       { return reinterpret_cast<const char*>(window + winPos); }
+    void peekConsume(size_t n) override     { consume(n); }
+    bool inputCanTimeout() override         { return false; }
+
+    // Refills the window once it has been handed out completely.
+    size_t peekAvailable() override {
+        if (winPos == winLen && pos < len) {
+            winPos = 0;
+            winLen = source.fill(window, windowSize);
+        }
+        return winLen - winPos;
+    }
+
+private:
+    BodySource& source;
+    uint8_t* window;
+    size_t windowSize;
+    size_t winPos = 0;
+    size_t winLen = 0;
+    size_t len = 0;
+    size_t pos = 0;
+    uint32_t drainedAt = 0;
+
+    void consume(size_t n) {
+        winPos += n;
+        pos += n;
+        if (pos >= len && !drainedAt) drainedAt = micros();
+    }
+};
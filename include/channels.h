@@ -0,0 +1,84 @@
+#pragma once
+
+#include <Arduino.h>
+#include "main.h"
+#include "sample_filter.h"
+
+// What a channel measures. The quantity fixes how it is stored and sent
+// and which DEADBAND threshold applies.
+enum class Quantity : uint8_t { TEMPERATURE, HUMIDITY, PRESSURE };
+
+// One value a sensor produces per reading.
+struct ChannelInfo {
+    const char* name;       // field name in the JSON payload
+    Quantity quantity;
+    PlausibleRange range;   // the sensor's operating range
+};
+
+// Fixed-point storage: temperature and humidity in 0.01 units in a 16-bit
+// slot, pressure in whole Pa in a 32-bit one. Standard deviations get one
+// more decimal for pressure.
+struct QuantityFormat {
+    uint8_t decimals;
+    uint8_t stdDecimals;
+    bool wide;
+};
+
+constexpr QuantityFormat formatOf(Quantity q) {
+    return q == Quantity::PRESSURE ? QuantityFormat{ 0, 1, true } : QuantityFormat{ 2, 2, false };
+}
+
+// 10^decimals, the factor from the channel's unit to its stored integer.
+constexpr float decimalScale(uint8_t decimals) {
+    return decimals ? 10.0f * decimalScale(decimals - 1) : 1.0f;
+}
+
+// A range bound in the channel's stored unit; the bounds are whole numbers
+// there, so truncation is exact.
+constexpr int32_t storedBound(float v, Quantity q) {
+    return (int32_t)(v * decimalScale(formatOf(q).decimals));
+}
+
+// A reading as a sensor hands it to the registry. The float path works in
+// the channel's unit (degC, %RH, Pa) and scales once per report. With
+// FIXED_POINT the drivers' integer compensation output is kept as the
+// record's scaled integer (0.01 degC, 0.01 %RH, Pa) all the way, so no
+// soft-float runs on the L106. Both are always defined so the bench can
+// time them side by side.
+#if FIXED_POINT
+typedef int32_t SensorValue;
+#else
+typedef float SensorValue;
+#endif
+
+template <typename T> struct Reading;
+
+template <> struct Reading<float> {
+    static constexpr float NONE = NAN;
+    static bool present(float v) { return !isnan(v); }
+    static int32_t stored(float v, uint8_t decimals) { return lroundf(v * decimalScale(decimals)); }
+};
+
+template <> struct Reading<int32_t> {
+    static constexpr int32_t NONE = INT32_MIN;
+    static bool present(int32_t v) { return v != NONE; }
+    static int32_t stored(int32_t v, uint8_t) { return v; }
+};
+
+// Channels per record, in registry order: every BME280 has temperature,
+// humidity and pressure, the SHT3x temperature and humidity.
+static constexpr size_t SENSOR_COUNT    = BME280_COUNT + (SHT3X ? 1 : 0);
+static constexpr size_t NARROW_CHANNELS = 2 * BME280_COUNT + (SHT3X ? 2 : 0);
+static constexpr size_t WIDE_CHANNELS   = BME280_COUNT;
+static constexpr size_t CHANNEL_COUNT   = NARROW_CHANNELS + WIDE_CHANNELS;
+
+static_assert(BME280_COUNT >= 1 && BME280_COUNT <= 2, "BME280_COUNT must be 1 or 2");
+static_assert(CHANNEL_COUNT <= 16, "The missing-channel mask is 16 bits");
+
+static constexpr uint16_t ALL_CHANNELS_MISSING = (uint16_t)((1ul << CHANNEL_COUNT) - 1);
+
+// Channel values of one record, indexed by slot rather than channel.
+struct ChannelValues {
+    int32_t wide[WIDE_CHANNELS];
+    int16_t narrow[NARROW_CHANNELS];
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Count, last and worst duration of one instrumented phase.
+struct PhaseTimer {
+    uint32_t count;
+    uint32_t lastUs;
+    uint32_t maxUs;
+
+    void record(uint32_t us) {
+        count++;
+        lastUs = us;
+        if (us > maxUs) maxUs = us;
+    }
+};
+
+// Where a node's time and heap go, accumulated since boot. Plain data;
+// a zeroed instance is the starting state. Not kept in RTC memory, so in
+// deep-sleep mode it covers the current wake only.
+struct Diagnostics {
+    PhaseTimer sensor;          // one Sensors::sample() sweep over every sensor of the registry
+    PhaseTimer wifi;            // association attempt until the IP is up
+    PhaseTimer upload;          // one DataSender::sendBatch()
+    uint32_t sensorRejected;    // readings outside the plausible range
+    uint16_t wifiAttempts;
+    uint16_t wifiFailures;
+    uint16_t uploadAttempts;
+    uint16_t uploadFailures;
+    uint32_t uploadRetries;     // transport-level retries, e.g. a stale keep-alive socket
+    uint32_t bytesSent;         // payload bytes handed to the transport successfully
+    uint32_t freeHeap;
+    uint32_t maxFreeBlock;      // much smaller than freeHeap means fragmentation
+
+    void sampleHeap() {
+        freeHeap     = ESP.getFreeHeap();
+        maxFreeBlock = ESP.getMaxFreeBlockSize();
+    }
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "main.h"
+
+// The I2C pins, with a way out for a bus a sensor holds by pulling SDA
+// low. That happens when the node resets in the middle of a read: the
+// sensor still waits to clock out the rest of its byte, and no
+// transaction gets through until it has.
+class I2cBus {
+public:
+    I2cBus(uint8_t sda, uint8_t scl) : sda(sda), scl(scl) {}
+
+    void begin() {
+        Wire.begin(sda, scl);
+        Wire.setClock(I2C_CLOCK_HZ);
+    }
+
+    // Clocks SCL until SDA is let go (nine pulses get any sensor to the
+    // end of its byte), sends a STOP and restarts Wire. Returns true if
+    // the bus was stuck and is free again. A bus held by SCL low cannot be
+    // freed from the master side.
+    bool recover() {
+        pinMode(sda, INPUT_PULLUP);
+        pinMode(scl, INPUT_PULLUP);
+        delayMicroseconds(HALF_CLOCK_US);
+        if (digitalRead(sda) == HIGH || digitalRead(scl) == LOW) return false;
+
+        digitalWrite(scl, HIGH);
+        pinMode(scl, OUTPUT_OPEN_DRAIN);
+        for (int i = 0; i < 9 && digitalRead(sda) == LOW; i++) {
+            digitalWrite(scl, LOW);
+            delayMicroseconds(HALF_CLOCK_US);
+            digitalWrite(scl, HIGH);
+            delayMicroseconds(HALF_CLOCK_US);
+        }
+
+        // STOP: SDA rises while SCL is high.
+        digitalWrite(scl, LOW);
+        digitalWrite(sda, LOW);
+        pinMode(sda, OUTPUT_OPEN_DRAIN);
+        delayMicroseconds(HALF_CLOCK_US);
+        digitalWrite(scl, HIGH);
+        delayMicroseconds(HALF_CLOCK_US);
+        digitalWrite(sda, HIGH);
+        delayMicroseconds(HALF_CLOCK_US);
+
+        pinMode(sda, INPUT_PULLUP);
+        bool freed = digitalRead(sda) == HIGH;
+        begin();
+        return freed;
+    }
+
+private:
+    static constexpr unsigned HALF_CLOCK_US = 5;   // 100 kHz
+
+    uint8_t sda;
+    uint8_t scl;
+};
+
+// Delay before the next sensor probe after `failures` in a row:
+// HEALTH_RETRY_MIN_MS, doubling up to HEALTH_RETRY_MAX_MS.
+inline uint32_t sensorRetryMs(uint16_t failures) {
+    uint32_t ms = HEALTH_RETRY_MIN_MS;
+    for (uint16_t i = 1; i < failures && ms < HEALTH_RETRY_MAX_MS; i++) ms *= 2;
+    return ms < HEALTH_RETRY_MAX_MS ? ms : HEALTH_RETRY_MAX_MS;
+}
+
+// An unplanned reset: either watchdog, or an exception.
+inline bool crashReset() {
+    uint32_t reason = ESP.getResetInfoPtr()->reason;
+    return reason == REASON_WDT_RST || reason == REASON_SOFT_WDT_RST || reason == REASON_EXCEPTION_RST;
+}
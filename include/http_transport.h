@@ -0,0 +1,268 @@
+#pragma once
+
+#include <ESP8266WiFi.h>
+#include <ESP8266HTTPClient.h>
+#if TLS
+#include <WiFiClientSecure.h>
+#include <type_traits>
+#endif
+#include "main.h"
+#include "remote_config.h"
+#include "rtc_state.h"
+#include "transport.h"
+
+// Wall time of each phase of the last upload, in microseconds. Phases
+// that were skipped (DNS and connect on a reused connection, or anything
+// after a failure) stay 0.
+struct HttpTimings {
+    uint32_t dnsUs;
+    uint32_t connectUs;     // with TLS, including the handshake
+    uint32_t writeUs;       // request headers and body handed to the socket
+    uint32_t firstByteUs;   // until the response status and headers arrived
+    uint32_t totalUs;
+    bool reused;
+    bool resumed;           // the TLS handshake resumed the cached session
+};
+
+#if TLS
+static_assert(sizeof(TLS_PUBKEY) > 1 || sizeof(TLS_FINGERPRINT) > 1, "TLS needs TLS_PUBKEY or TLS_FINGERPRINT");
+static_assert(std::is_trivially_copyable<BearSSL::Session>::value && sizeof(BearSSL::Session) <= TLS_SESSION_BYTES,
+              "BearSSL::Session does not fit the RTC copy");
+#endif
+
+// With TLS the server is authenticated by its public key (TLS_PUBKEY, a
+// PEM) or else its certificate's SHA-1 fingerprint, so no CA store or
+// chain validation is needed. The record buffers are cut to TLS_RX_BUFFER
+// and TLS_TX_BUFFER where the server accepts the max fragment length
+// extension; that is probed once and remembered in RTC memory. The
+// session of the last handshake is reused for the next connection, from
+// RTC memory after deep sleep with TLS_SESSION_RTC, which saves the key
+// exchange and the server's certificate flight. BearSSL has no session
+// tickets, so this relies on the server's session cache.
+//
+// With REMOTE_CONFIG the backend may answer a POST with a config block
+// (remote_config.h) as the 200 response body.
+class HttpTransport : public Transport {
+public:
+#if TLS
+    HttpTransport(const char* serverUrl, const char* endpoint, TlsCache& tls) : serverKey(TLS_PUBKEY), tls(tls) {
+        parseUrl(String(serverUrl) + endpoint);
+        if (sizeof(TLS_PUBKEY) > 1) client.setKnownKey(&serverKey);
+        else client.setFingerprint(TLS_FINGERPRINT);
+        client.setSession(&session);
+    }
+#else
+    HttpTransport(const char* serverUrl, const char* endpoint) {
+        parseUrl(String(serverUrl) + endpoint);
+    }
+#endif
+
+    const char* name() const override { return "http"; }
+
+    const HttpTimings& lastTimings() const { return timings; }
+
+    bool send(BodyStream& body, const char* contentType, uint32_t sequence) override {
+        (void)sequence;
+        int code = post(body, contentType);
+        if (code > 0) {
+            const char* handshake = !TLS || !timings.connectUs ? "" : timings.resumed ? " resumed" : " full handshake";
+            Serial.printf("HTTP code: %d (dns %u, connect %u%s, write %u, ttfb %u us)\n", code, timings.dnsUs,
+                          timings.connectUs, handshake, timings.writeUs, timings.firstByteUs);
+        } else {
+            Serial.printf("Failed to send data: %s\n", http.errorToString(code).c_str());
+        }
+        return code > 0;
+    }
+
+    void stop() override { closeSession(); }
+    uint32_t retries() const override { return retryCount; }
+
+#if REMOTE_CONFIG
+    size_t takeReply(char* buf, size_t capacity) override {
+        size_t n = replyLen < capacity ? replyLen : capacity;
+        memcpy(buf, reply, n);
+        replyLen = 0;
+        return n;
+    }
+#endif
+
+    // The socket uploads go through, with the TLS settings of the server,
+    // for the OTA check. Only use it while no upload is in progress.
+    WiFiClient& socket() { return client; }
+
+private:
+    HTTPClient http;
+#if TLS
+    // Largest record a server may send without the fragment length
+    // extension: 16 KB of data plus BearSSL's overhead.
+    static constexpr int FULL_RECORD_BUFFER = 16384 + 325;
+    enum : uint8_t { FRAGMENT_UNKNOWN, FRAGMENT_ACCEPTED, FRAGMENT_REFUSED };
+
+    BearSSL::WiFiClientSecure client;
+    BearSSL::PublicKey serverKey;
+    BearSSL::Session session;
+    TlsCache& tls;
+    bool sessionLoaded = false;
+#else
+    WiFiClient client;
+#endif
+    bool sessionOpen = false;
+    uint32_t retryCount = 0;
+    HttpTimings timings = {};
+    String host;
+    String uri;
+    uint16_t port = TLS ? 443 : 80;
+#if REMOTE_CONFIG
+    char reply[ConfigParser::MAX_BLOCK];
+    size_t replyLen = 0;
+#endif
+
+    // The connection is opened here rather than inside HTTPClient so DNS
+    // and connect can be timed and bounded by CONNECT_TIMEOUT_MS.
+    // HTTPClient is always in reuse mode and just takes over the open
+    // socket; without HTTP_KEEPALIVE we close it ourselves after each POST.
+    //
+    // A kept-alive socket the server dropped silently only fails on use,
+    // so that case is retried once on a fresh connection.
+    int post(BodyStream& body, const char* contentType) {
+        uint32_t start = micros();
+        timings = {};
+
+        int code = postOnce(body, contentType);
+        if (HTTP_KEEPALIVE && timings.reused && isConnectionError(code)) {
+            closeSession();
+            retryCount++;
+            body.rewind();
+            code = postOnce(body, contentType);
+        }
+
+#if REMOTE_CONFIG
+        if (code == HTTP_CODE_OK) keepReply();
+#endif
+        if (!HTTP_KEEPALIVE || code < 0) closeSession();
+        timings.totalUs = micros() - start;
+        return code;
+    }
+
+#if REMOTE_CONFIG
+    // Keeps a response body short enough to be a config block. Longer or
+    // chunked ones are skipped by HTTPClient when the request ends.
+    void keepReply() {
+        int size = http.getSize();
+        replyLen = size > 0 && size <= (int)sizeof(reply) ? http.getStream().readBytes(reply, size) : 0;
+    }
+#endif
+
+    int postOnce(BodyStream& body, const char* contentType) {
+        timings.reused = sessionOpen && client.connected();
+        if (!timings.reused) {
+            closeSession();
+            if (!openConnection()) return HTTPC_ERROR_CONNECTION_FAILED;
+            http.setReuse(true);
+            http.setTimeout(TCP_TIMEOUT_MS);
+            http.begin(client, host, port, uri, TLS);
+            http.addHeader("Content-Type", contentType);
+            sessionOpen = true;
+        }
+
+        // Content-Length is known up front, so the core streams the body
+        // from the window straight into the socket.
+        uint32_t writeStart = micros();
+        int code = http.sendRequest("POST", &body, body.length());
+        uint32_t end = micros();
+
+        if (body.drained()) {
+            timings.writeUs = body.drainedAtUs() - writeStart;
+            timings.firstByteUs = end - body.drainedAtUs();
+        }
+        return code;
+    }
+
+    bool openConnection() {
+        IPAddress ip;
+        uint32_t t0 = micros();
+        if (!WiFi.hostByName(host.c_str(), ip, CONNECT_TIMEOUT_MS)) {
+            Serial.printf("DNS lookup for %s failed\n", host.c_str());
+            return false;
+        }
+        uint32_t t1 = micros();
+        timings.dnsUs = t1 - t0;
+
+        client.setTimeout(CONNECT_TIMEOUT_MS);
+#if TLS
+        prepareTls(ip);
+        uint8_t offered[sizeof(session)];
+        memcpy(offered, &session, sizeof(session));
+#endif
+        bool ok = client.connect(ip, port);
+        timings.connectUs = micros() - t1;
+        client.setTimeout(TCP_TIMEOUT_MS);
+#if TLS
+        // A resumed handshake leaves the session as it was offered; a full
+        // one brings a new id and master secret.
+        if (ok) {
+            timings.resumed = tls.sessionValid && !memcmp(offered, &session, sizeof(session));
+            tls.sessionValid = 1;
+#if TLS_SESSION_RTC
+            memcpy(tls.session, &session, sizeof(session));
+#endif
+        }
+#endif
+        return ok;
+    }
+
+#if TLS
+    // Sizes the record buffers and, once per boot, restores the session a
+    // previous wake left in RTC memory. A probe that fails for network
+    // reasons also counts as refused until the next cold boot, which only
+    // costs buffer space.
+    void prepareTls(IPAddress ip) {
+        if (tls.fragmentProbe == FRAGMENT_UNKNOWN) {
+            bool accepted = BearSSL::WiFiClientSecure::probeMaxFragmentLength(ip, port, TLS_RX_BUFFER);
+            tls.fragmentProbe = accepted ? FRAGMENT_ACCEPTED : FRAGMENT_REFUSED;
+            if (!accepted) Serial.printf("%s refuses %d-byte TLS records\n", host.c_str(), TLS_RX_BUFFER);
+        }
+        client.setBufferSizes(tls.fragmentProbe == FRAGMENT_ACCEPTED ? TLS_RX_BUFFER : FULL_RECORD_BUFFER,
+                              TLS_TX_BUFFER);
+
+        if (!sessionLoaded) {
+            sessionLoaded = true;
+#if TLS_SESSION_RTC
+            if (tls.sessionValid) memcpy(&session, tls.session, sizeof(session));
+#else
+            tls.sessionValid = 0;
+#endif
+        }
+    }
+#endif
+
+    void closeSession() {
+        if (sessionOpen) http.end();
+        client.stop();
+        sessionOpen = false;
+    }
+
+    // Accepts "http[s]://host[:port]/path" or a bare "host[:port]/path";
+    // the scheme is ignored, TLS decides.
+    void parseUrl(const String& url) {
+        int hostStart = url.indexOf("://");
+        hostStart = hostStart < 0 ? 0 : hostStart + 3;
+
+        int pathStart = url.indexOf('/', hostStart);
+        String authority = pathStart < 0 ? url.substring(hostStart) : url.substring(hostStart, pathStart);
+        uri = pathStart < 0 ? String("/") : url.substring(pathStart);
+
+        int colon = authority.indexOf(':');
+        if (colon < 0) {
+            host = authority;
+        } else {
+            host = authority.substring(0, colon);
+            port = (uint16_t)authority.substring(colon + 1).toInt();
+        }
+    }
+
+    static bool isConnectionError(int code) {
+        return code == HTTPC_ERROR_SEND_HEADER_FAILED || code == HTTPC_ERROR_SEND_PAYLOAD_FAILED ||
+               code == HTTPC_ERROR_NOT_CONNECTED || code == HTTPC_ERROR_CONNECTION_LOST;
+    }
+};
@@ -10,3 +10,86 @@
 #define INTERVAL_MS       CONFIG_INTERVAL_MS
 #define WIFI_TIMEOUT_MS   CONFIG_WIFI_TIMEOUT_MS
 #define TCP_TIMEOUT_MS    CONFIG_TCP_TIMEOUT_MS
+#define FORCED_MODE       CONFIG_FORCED_MODE
+#define OVERSAMPLING_TEMP CONFIG_OVERSAMPLING_TEMP
+#define OVERSAMPLING_PRES CONFIG_OVERSAMPLING_PRES
+#define OVERSAMPLING_HUM  CONFIG_OVERSAMPLING_HUM
+#define IIR_COEFF         CONFIG_IIR_COEFF
+#define DEEP_SLEEP        CONFIG_DEEP_SLEEP
+#define RTC_BUFFER_SIZE   CONFIG_RTC_BUFFER_SIZE
+#define UPLOAD_EVERY      CONFIG_UPLOAD_EVERY
+#define HTTP_KEEPALIVE    CONFIG_HTTP_KEEPALIVE
+#define WIFI_BACKOFF_MIN_MS CONFIG_WIFI_BACKOFF_MIN_MS
+#define WIFI_BACKOFF_MAX_MS CONFIG_WIFI_BACKOFF_MAX_MS
+#define WIFI_WAKE_BACKOFF_MAX_MS CONFIG_WIFI_WAKE_BACKOFF_MAX_MS
+#define WIFI_FAST_CONNECT CONFIG_WIFI_FAST_CONNECT
+#define WIFI_FAST_TIMEOUT_MS CONFIG_WIFI_FAST_TIMEOUT_MS
+#define CONNECT_TIMEOUT_MS CONFIG_CONNECT_TIMEOUT_MS
+#define PAYLOAD_FORMAT    CONFIG_PAYLOAD_FORMAT
+#define TRANSPORT         CONFIG_TRANSPORT
+#define MQTT_HOST         CONFIG_MQTT_HOST
+#define MQTT_PORT         CONFIG_MQTT_PORT
+#define MQTT_USER         CONFIG_MQTT_USER
+#define MQTT_PASS         CONFIG_MQTT_PASS
+#define MQTT_TOPIC_PREFIX CONFIG_MQTT_TOPIC_PREFIX
+#define MQTT_QOS          CONFIG_MQTT_QOS
+#define UDP_HOST          CONFIG_UDP_HOST
+#define UDP_PORT          CONFIG_UDP_PORT
+#define UDP_ACK           CONFIG_UDP_ACK
+#define UDP_ACK_TIMEOUT_MS CONFIG_UDP_ACK_TIMEOUT_MS
+#define WINDOW_STATS      CONFIG_WINDOW_STATS
+#define STATS_SAMPLE_MS   CONFIG_STATS_SAMPLE_MS
+#define FILTER_MODE       CONFIG_FILTER_MODE
+#define FILTER_TRIM       CONFIG_FILTER_TRIM
+#define DEADBAND          CONFIG_DEADBAND
+#define DEADBAND_TEMP     CONFIG_DEADBAND_TEMP
+#define DEADBAND_HUM      CONFIG_DEADBAND_HUM
+#define DEADBAND_PRES     CONFIG_DEADBAND_PRES
+#define DEADBAND_HEARTBEAT_S CONFIG_DEADBAND_HEARTBEAT_S
+#define WIFI_SLEEP        CONFIG_WIFI_SLEEP
+#define WIFI_LISTEN_INTERVAL CONFIG_WIFI_LISTEN_INTERVAL
+#define DIAG_PAYLOAD      CONFIG_DIAG_PAYLOAD
+#define SPILL_LOG         CONFIG_SPILL_LOG
+#define SPILL_SEGMENT_RECORDS CONFIG_SPILL_SEGMENT_RECORDS
+#define SPILL_MAX_SEGMENTS CONFIG_SPILL_MAX_SEGMENTS
+#define SPILL_CHUNK       CONFIG_SPILL_CHUNK
+#define BME280_COUNT      CONFIG_BME280_COUNT
+#define SHT3X             CONFIG_SHT3X
+#define I2C_CLOCK_HZ      CONFIG_I2C_CLOCK_HZ
+#define I2C_SDA_PIN       CONFIG_I2C_SDA_PIN
+#define I2C_SCL_PIN       CONFIG_I2C_SCL_PIN
+#define FIXED_POINT       CONFIG_FIXED_POINT
+#define TIME_SYNC         CONFIG_TIME_SYNC
+#define NTP_SERVER        CONFIG_NTP_SERVER
+#define NTP_RESYNC_S      CONFIG_NTP_RESYNC_S
+#define NTP_TIMEOUT_MS    CONFIG_NTP_TIMEOUT_MS
+#define ADAPTIVE_INTERVAL CONFIG_ADAPTIVE_INTERVAL
+#define INTERVAL_MIN_MS   CONFIG_INTERVAL_MIN_MS
+#define INTERVAL_MAX_MS   CONFIG_INTERVAL_MAX_MS
+#define ADAPT_TEMP        CONFIG_ADAPT_TEMP
+#define ADAPT_HUM         CONFIG_ADAPT_HUM
+#define ADAPT_PRES        CONFIG_ADAPT_PRES
+#define TLS               CONFIG_TLS
+#define TLS_FINGERPRINT   CONFIG_TLS_FINGERPRINT
+#define TLS_PUBKEY        CONFIG_TLS_PUBKEY
+#define TLS_RX_BUFFER     CONFIG_TLS_RX_BUFFER
+#define TLS_TX_BUFFER     CONFIG_TLS_TX_BUFFER
+#define TLS_SESSION_RTC   CONFIG_TLS_SESSION_RTC
+#define REMOTE_CONFIG     CONFIG_REMOTE_CONFIG
+#define OTA               CONFIG_OTA
+#define OTA_URL           CONFIG_OTA_URL
+#define OTA_CHECK_S       CONFIG_OTA_CHECK_S
+#define FIRMWARE_VERSION  CONFIG_FIRMWARE_VERSION
+#define HEALTH_RETRY_MIN_MS CONFIG_HEALTH_RETRY_MIN_MS
+#define HEALTH_RETRY_MAX_MS CONFIG_HEALTH_RETRY_MAX_MS
+
+#define PAYLOAD_JSON      0
+#define PAYLOAD_BINARY    1
+
+#define TRANSPORT_HTTP    0
+#define TRANSPORT_MQTT    1
+#define TRANSPORT_UDP     2
+
+#define FILTER_MEAN       0
+#define FILTER_MEDIAN     1
+#define FILTER_TRIMMED    2
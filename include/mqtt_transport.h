@@ -0,0 +1,127 @@
+#pragma once
+
+#include <ESP8266WiFi.h>
+#include <MQTT.h>
+#include <memory>
+#include "main.h"
+#include "remote_config.h"
+#include "transport.h"
+
+// Publishes each payload to "<MQTT_TOPIC_PREFIX>/<DEVICE_NAME>/readings".
+// The session is persistent (clean session off, client id = device name)
+// so QoS 1 messages in flight survive a reconnect, and the keepalive is
+// derived from the upload period so an idle node needs no extra PINGs
+// between publishes. The library needs the whole payload in one piece,
+// so the body is copied into a buffer of payloadCapacity bytes first.
+//
+// With REMOTE_CONFIG the node also subscribes to
+// "<MQTT_TOPIC_PREFIX>/<DEVICE_NAME>/config" at QoS 1 when the broker
+// holds no session for it. A config block published there retained
+// reaches a new session on subscribe and an existing one, even if it
+// was offline, at the next connect.
+class MqttTransport : public Transport {
+public:
+    static constexpr uint32_t UPLOAD_PERIOD_S =
+        (uint32_t)((uint64_t)(ADAPTIVE_INTERVAL ? INTERVAL_MAX_MS : INTERVAL_MS) * UPLOAD_EVERY / 1000);
+    static constexpr int KEEPALIVE_S = UPLOAD_PERIOD_S + 30 > 0xFFFF ? 0xFFFF : (int)(UPLOAD_PERIOD_S + 30);
+
+    MqttTransport(const char* host, uint16_t port, const char* user, const char* pass,
+                  const char* clientId, size_t payloadCapacity)
+        : mqtt(payloadCapacity + 64), payload(new char[payloadCapacity]), payloadCapacity(payloadCapacity),
+          host(host), port(port), user(user), pass(pass), clientId(clientId),
+          topic(String(MQTT_TOPIC_PREFIX) + "/" + clientId + "/readings") {
+#if REMOTE_CONFIG
+        configTopic = String(MQTT_TOPIC_PREFIX) + "/" + clientId + "/config";
+#endif
+    }
+
+    const char* name() const override { return "mqtt"; }
+
+    bool send(BodyStream& body, const char* contentType, uint32_t sequence) override {
+        (void)contentType;
+        (void)sequence;
+        size_t len = body.length();
+        if (len > payloadCapacity) {
+            Serial.printf("Payload of %u bytes does not fit the MQTT buffer\n", (unsigned)len);
+            return false;
+        }
+        if ((size_t)body.read(reinterpret_cast<uint8_t*>(payload.get()), len) != len) return false;
+        if (!ensureConnected()) return false;
+
+        if (!mqtt.publish(topic.c_str(), payload.get(), (int)len, false, MQTT_QOS)) {
+            Serial.printf("MQTT publish failed (error %d)\n", (int)mqtt.lastError());
+            mqtt.disconnect();
+            return false;
+        }
+        // Picks up a config block that came in while waiting for the PUBACK.
+        if (REMOTE_CONFIG) mqtt.loop();
+        return true;
+    }
+
+    // Services incoming packets (PUBACKs, PINGRESPs) and the keepalive.
+    void maintain() override {
+        if (started && mqtt.connected()) mqtt.loop();
+    }
+
+    void stop() override {
+        if (started) mqtt.disconnect();
+    }
+
+#if REMOTE_CONFIG
+    size_t takeReply(char* buf, size_t capacity) override {
+        size_t n = replyLen < capacity ? replyLen : capacity;
+        memcpy(buf, reply, n);
+        replyLen = 0;
+        return n;
+    }
+#endif
+
+private:
+    MQTTClient mqtt;
+    WiFiClient client;
+    std::unique_ptr<char[]> payload;
+    size_t payloadCapacity;
+    const char* host;
+    uint16_t port;
+    const char* user;
+    const char* pass;
+    const char* clientId;
+    const String topic;
+    bool started = false;
+#if REMOTE_CONFIG
+    String configTopic;
+    char reply[ConfigParser::MAX_BLOCK];
+    size_t replyLen = 0;
+#endif
+
+    bool ensureConnected() {
+        if (!started) {
+            mqtt.begin(host, port, client);
+            mqtt.setKeepAlive(KEEPALIVE_S);
+            mqtt.setCleanSession(false);
+            mqtt.setTimeout(TCP_TIMEOUT_MS);
+#if REMOTE_CONFIG
+            mqtt.onMessageAdvanced([this](MQTTClient*, char msgTopic[], char bytes[], int length) {
+                if (strcmp(msgTopic, configTopic.c_str()) || length <= 0 || length > (int)sizeof(reply)) return;
+                memcpy(reply, bytes, length);
+                replyLen = length;
+            });
+#endif
+            started = true;
+        }
+        if (mqtt.connected()) return true;
+
+        client.setTimeout(CONNECT_TIMEOUT_MS);
+        bool ok = *user ? mqtt.connect(clientId, user, pass) : mqtt.connect(clientId);
+        if (!ok) {
+            Serial.printf("MQTT connect to %s:%u failed (error %d, rc %d)\n", host, port,
+                          (int)mqtt.lastError(), (int)mqtt.returnCode());
+        }
+#if REMOTE_CONFIG
+        if (ok && !mqtt.sessionPresent() && !mqtt.subscribe(configTopic.c_str(), 1)) {
+            Serial.printf("MQTT subscribe to %s failed\n", configTopic.c_str());
+        }
+#endif
+        return ok;
+    }
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <ESP8266WiFi.h>
+#include <ESP8266httpUpdate.h>
+#include "main.h"
+
+// Pull-based firmware update. The core's updater sends FIRMWARE_VERSION
+// as the x-ESP8266-version header; the server answers 304 when that is
+// current, or with the new image, which is flashed and booted straight
+// away. A check that finds nothing costs one request, so the caller only
+// decides how rarely to make it.
+class OtaUpdater {
+public:
+    OtaUpdater(WiFiClient& client, const char* url, const char* version)
+        : client(client), url(url), version(version) {}
+
+    // Returns unless an update was installed, which reboots.
+    void check() {
+        ESPhttpUpdate.rebootOnUpdate(true);
+        ESPhttpUpdate.setClientTimeout(TCP_TIMEOUT_MS);
+
+        switch (ESPhttpUpdate.update(client, url, version)) {
+        case HTTP_UPDATE_NO_UPDATES:
+            Serial.printf("Firmware %s is current\n", version);
+            break;
+        case HTTP_UPDATE_FAILED:
+            Serial.printf("Firmware update failed: %s\n", ESPhttpUpdate.getLastErrorString().c_str());
+            break;
+        case HTTP_UPDATE_OK:
+            break;
+        }
+        client.stop();
+    }
+
+private:
+    WiFiClient& client;
+    const char* url;
+    const char* version;
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Appends text into a caller-owned fixed buffer without touching the heap.
+// Numbers are formatted from scaled integers, so no soft-float is needed.
+// Once an append does not fit, the writer stays in the failed state and
+// the payload must not be sent.
+class PayloadWriter {
+public:
+    PayloadWriter(char* buf, size_t capacity) : buf(buf), capacity(capacity) { reset(); }
+
+    void reset() {
+        len = 0;
+        overflow = false;
+        buf[0] = '\0';
+    }
+
+    // Drops everything after the first `n` bytes and clears the failed
+    // state, to back out an append that did not fit.
+    void truncate(size_t n) {
+        if (n < len) len = n;
+        overflow = false;
+        buf[len] = '\0';
+    }
+
+    bool ok() const              { return !overflow; }
+    const char* c_str() const    { return buf; }
+    const uint8_t* data() const  { return reinterpret_cast<const uint8_t*>(buf); }
+    size_t length() const        { return len; }
+
+    PayloadWriter& raw(const char* s) {
+        while (*s) put(*s++);
+        return terminate();
+    }
+
+    PayloadWriter& raw(char c) {
+        put(c);
+        return terminate();
+    }
+
+    // JSON string literal, including the surrounding quotes.
+    PayloadWriter& quoted(const char* s) {
+        put('"');
+        for (; *s; s++) {
+            char c = *s;
+            if (c == '"' || c == '\\') {
+                put('\\');
+                put(c);
+            } else if ((uint8_t)c < 0x20) {
+                static const char hex[] = "0123456789abcdef";
+                put('\\'); put('u'); put('0'); put('0');
+                put(hex[(uint8_t)c >> 4]);
+                put(hex[c & 0x0F]);
+            } else {
+                put(c);
+            }
+        }
+        put('"');
+        return terminate();
+    }
+
+    PayloadWriter& number(uint32_t v) {
+        char tmp[10];
+        uint8_t n = 0;
+        do {
+            tmp[n++] = '0' + v % 10;
+            v /= 10;
+        } while (v);
+        while (n) put(tmp[--n]);
+        return terminate();
+    }
+
+    PayloadWriter& signedNumber(int32_t v) {
+        if (v < 0) {
+            put('-');
+            return number((uint32_t)0 - (uint32_t)v);
+        }
+        return number((uint32_t)v);
+    }
+
+    // `v` scaled by 10^decimals, e.g. fixed(-1234, 2) writes "-12.34".
+    PayloadWriter& fixed(int32_t v, uint8_t decimals) {
+        uint32_t mag = v < 0 ? (uint32_t)0 - (uint32_t)v : (uint32_t)v;
+        uint32_t scale = 1;
+        for (uint8_t i = 0; i < decimals; i++) scale *= 10;
+
+        if (v < 0) put('-');
+        number(mag / scale);
+        if (decimals) {
+            put('.');
+            uint32_t frac = mag % scale;
+            for (uint32_t div = scale / 10; div; div /= 10) put('0' + (frac / div) % 10);
+        }
+        return terminate();
+    }
+
+private:
+    char* buf;
+    size_t capacity;
+    size_t len;
+    bool overflow;
+
+    void put(char c) {
+        if (len + 1 < capacity) buf[len++] = c;
+        else overflow = true;
+    }
+
+    PayloadWriter& terminate() {
+        buf[len] = '\0';
+        return *this;
+    }
+};
+
+// Little-endian counterpart of PayloadWriter for the binary upload format.
+class BinaryWriter {
+public:
+    BinaryWriter(uint8_t* buf, size_t capacity) : buf(buf), capacity(capacity) {}
+
+    void truncate(size_t n) {
+        if (n < len) len = n;
+        overflow = false;
+    }
+
+    bool ok() const             { return !overflow; }
+    const uint8_t* data() const { return buf; }
+    size_t length() const       { return len; }
+
+    BinaryWriter& u8(uint8_t v) {
+        if (len < capacity) buf[len++] = v;
+        else overflow = true;
+        return *this;
+    }
+
+    BinaryWriter& u16(uint16_t v) { return u8(v & 0xFF).u8(v >> 8); }
+    BinaryWriter& u32(uint32_t v) { return u16(v & 0xFFFF).u16(v >> 16); }
+    BinaryWriter& i16(int16_t v)  { return u16((uint16_t)v); }
+
+    // Length-prefixed string, truncated to 255 bytes.
+    BinaryWriter& str(const char* s) {
+        size_t n = strlen(s);
+        if (n > 0xFF) n = 0xFF;
+        u8((uint8_t)n);
+        for (size_t i = 0; i < n; i++) u8((uint8_t)s[i]);
+        return *this;
+    }
+
+private:
+    uint8_t* buf;
+    size_t capacity;
+    size_t len = 0;
+    bool overflow = false;
+};
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <coredecls.h>
+#include <stdlib.h>
+#include "main.h"
+
+// Parameters the backend can retune without a reflash. They start out as
+// the build flags; a config block replaces them. The block in use lives in
+// RTC memory for the next wakes and in flash for the next power-up.
+// The sample count and the filter stay compile-time, since the sample
+// pipeline is sized by them, and so does the server address, which a bad
+// push could make unreachable for good. Whoever can answer an upload can
+// push a block, so this is meant for TLS=1 or a trusted network.
+struct RuntimeConfig {
+    uint32_t intervalMs;    // report interval without ADAPTIVE_INTERVAL
+    uint16_t version;       // "v" of the block in use, 0 for the build flags
+    uint8_t  uploadEvery;
+    uint8_t  reserved;
+    int16_t  deadbandTemp;  // 0.01 degC
+    int16_t  deadbandHum;   // 0.01 %RH
+    int16_t  deadbandPres;  // Pa
+    uint16_t heartbeatS;
+
+    static RuntimeConfig defaults() {
+        static_assert(UPLOAD_EVERY <= 0xFF && DEADBAND_PRES <= 0x7FFF && DEADBAND_HEARTBEAT_S <= 0xFFFF,
+                      "Build defaults out of range for RuntimeConfig");
+        return { INTERVAL_MS, 0, UPLOAD_EVERY, 0, (int16_t)(DEADBAND_TEMP * 100 + 0.5f),
+                 (int16_t)(DEADBAND_HUM * 100 + 0.5f), DEADBAND_PRES, DEADBAND_HEARTBEAT_S };
+    }
+};
+
+// A config block is a flat JSON object of numbers, for example
+//
+//   {"v":7,"interval_ms":600000,"upload_every":6,"deadband_temp":0.3}
+//
+// Keys left out keep their current value and unknown keys are skipped,
+// strings and literals included, so the server may send more than this.
+// It is only taken as a whole: "v" must be there and every known value in
+// range, otherwise nothing changes.
+class ConfigParser {
+public:
+    // Longest block a transport keeps; a longer reply is not a config block.
+    static constexpr size_t MAX_BLOCK = 192;
+
+    // `json` must be NUL-terminated. On success `cfg` holds the result.
+    // `maxUploadEvery` is the ring capacity, which the RTC layout decides.
+    static bool parse(const char* json, RuntimeConfig& cfg, size_t maxUploadEvery) {
+        ConfigParser p(json);
+        RuntimeConfig next = cfg;
+        bool versioned = false;
+
+        if (!p.consume('{')) return false;
+        if (p.consume('}')) return false;
+        do {
+            char key[24];
+            if (!p.string(key, sizeof(key)) || !p.consume(':')) return false;
+
+            double v;
+            if (!p.number(v)) {
+                if (!p.skipValue()) return false;
+                continue;
+            }
+            if (!strcmp(key, "v")) {
+                if (!set(next.version, v, 1, 0xFFFF)) return false;
+                versioned = true;
+            } else if (!strcmp(key, "interval_ms") && !set(next.intervalMs, v, MIN_INTERVAL_MS, MAX_INTERVAL_MS)) {
+                return false;
+            } else if (!strcmp(key, "upload_every") && !set(next.uploadEvery, v, 1, maxUploadEvery)) {
+                return false;
+            } else if (!strcmp(key, "deadband_temp") && !set(next.deadbandTemp, v * 100, 0, 10000)) {
+                return false;
+            } else if (!strcmp(key, "deadband_hum") && !set(next.deadbandHum, v * 100, 0, 10000)) {
+                return false;
+            } else if (!strcmp(key, "deadband_pres") && !set(next.deadbandPres, v, 0, 10000)) {
+                return false;
+            } else if (!strcmp(key, "heartbeat_s") && !set(next.heartbeatS, v, 60, 0xFFFF)) {
+                return false;
+            }
+        } while (p.consume(','));
+
+        if (!p.consume('}') || !versioned) return false;
+        cfg = next;
+        return true;
+    }
+
+private:
+    // Sampling takes a second; the deep-sleep timer cannot do much more
+    // than three hours.
+    static constexpr uint32_t MIN_INTERVAL_MS = 10000;
+    static constexpr uint32_t MAX_INTERVAL_MS = 3 * 3600000ul;
+
+    const char* p;
+
+    explicit ConfigParser(const char* json) : p(json) {}
+
+    void skipSpace() {
+        while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+    }
+
+    bool consume(char c) {
+        skipSpace();
+        if (*p != c) return false;
+        p++;
+        return true;
+    }
+
+    // Keys are plain ASCII; an escape or an overlong key fails the block.
+    bool string(char* out, size_t capacity) {
+        if (!consume('"')) return false;
+        size_t n = 0;
+        for (; *p && *p != '"'; p++) {
+            if (*p == '\\' || n + 1 >= capacity) return false;
+            out[n++] = *p;
+        }
+        out[n] = '\0';
+        return consume('"');
+    }
+
+    bool number(double& out) {
+        skipSpace();
+        if (*p != '-' && (*p < '0' || *p > '9')) return false;
+        char* end;
+        out = strtod(p, &end);
+        p = end;
+        return true;
+    }
+
+    // A string, true, false or null; nested values are not expected.
+    bool skipValue() {
+        skipSpace();
+        if (*p == '"') {
+            for (p++; *p && *p != '"'; p++) {
+                if (*p == '\\' && p[1]) p++;
+            }
+            return consume('"');
+        }
+        for (const char* word : { "true", "false", "null" }) {
+            size_t n = strlen(word);
+            if (!strncmp(p, word, n)) {
+                p += n;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Rounds to the nearest integer and checks the range.
+    template <typename T>
+    static bool set(T& field, double v, double lo, double hi) {
+        double r = v < 0 ? v - 0.5 : v + 0.5;
+        if (!(r >= lo && r < hi + 1)) return false;
+        field = (T)(long long)r;
+        return true;
+    }
+};
+
+// Flash copy of the block in use, read on a cold boot. It is only
+// rewritten when a new version arrives.
+class ConfigStore {
+public:
+    bool load(RuntimeConfig& cfg) {
+        if (!LittleFS.begin()) return false;
+        File f = LittleFS.open(PATH, "r");
+        if (!f) return false;
+        Stored s;
+        bool ok = f.read(reinterpret_cast<uint8_t*>(&s), sizeof(s)) == (int)sizeof(s) && s.magic == MAGIC &&
+                  s.crc == crc32(&s.config, sizeof(s.config));
+        f.close();
+        if (ok) cfg = s.config;
+        return ok;
+    }
+
+    bool save(const RuntimeConfig& cfg) {
+        if (!LittleFS.begin()) return false;
+        Stored s = { MAGIC, crc32(&cfg, sizeof(cfg)), cfg };
+        File f = LittleFS.open(PATH, "w");
+        if (!f) return false;
+        bool ok = f.write(reinterpret_cast<const uint8_t*>(&s), sizeof(s)) == sizeof(s);
+        f.close();
+        return ok;
+    }
+
+private:
+    static constexpr const char* PATH = "/config.bin";
+    static constexpr uint32_t MAGIC = 0xC0F1D001;
+
+    struct Stored {
+        uint32_t magic;
+        uint32_t crc;
+        RuntimeConfig config;
+    };
+};
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <Arduino.h>
+#include <coredecls.h>
+#include "main.h"
+#include "remote_config.h"
+#include "sample_buffer.h"
+
+// Last good association, so a reconnect can skip the channel scan and
+// DHCP. Addresses are stored as raw IPv4 values.
+struct WiFiCache {
+    uint8_t  bssid[6];
+    uint8_t  channel;
+    uint8_t  valid;
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t mask;
+    uint32_t dns;
+};
+
+// Last queued report, which DEADBAND compares new readings against.
+struct DeadbandState {
+    ChannelValues values;
+    uint16_t missing;
+    uint8_t  valid;
+    uint8_t  reserved;
+    uint32_t atSec;         // device clock when it was queued
+};
+
+// Last sample taken, which ADAPTIVE_INTERVAL measures the rate of change
+// against, and the interval that came out of it.
+struct AdaptiveState {
+    ChannelValues values;
+    uint16_t missing;
+    uint8_t  valid;
+    uint8_t  intervalShift; // the interval is INTERVAL_MIN_MS << intervalShift
+    uint32_t atSec;         // device clock when it was taken
+};
+
+// Faults seen since the last upload, for its health block. Kept here so a
+// fault noticed on a radio-off wake is still reported.
+struct HealthState {
+    uint8_t downSensors;    // bit per sensor that did not answer at the last probe
+    uint8_t busRecoveries;  // stuck I2C buses freed, saturating
+    uint8_t crashResets;    // boots after a watchdog or exception reset, saturating
+    uint8_t pending;        // something changed that was not reported yet
+};
+
+// Wall-clock calibration from the last SNTP answer. Unix time is the
+// device clock plus a whole number of seconds, so a record's device-clock
+// second converts exactly.
+struct ClockSync {
+    uint32_t offsetSec;     // Unix time minus device clock
+    uint32_t syncedAtSec;   // device clock of the last sync
+    uint32_t sleptMs;       // deep sleep requested since then
+    int32_t  sleepDriftPpm; // how much longer the sleep timer runs than asked
+    uint8_t  valid;
+    uint8_t  driftMeasured;
+    uint8_t  reserved[2];
+};
+
+// What the HTTPS transport learned about the server. The session lets a
+// wake resume instead of running a full handshake; keeping it here costs
+// TLS_SESSION_BYTES of RTC memory, about seven ring records.
+static constexpr size_t TLS_SESSION_BYTES = 88;   // br_ssl_session_parameters, rounded up
+
+struct TlsCache {
+    uint8_t fragmentProbe;  // TLS_RX_BUFFER records: 0 not probed, 1 accepted, 2 refused
+    uint8_t sessionValid;
+    uint8_t reserved[2];
+#if TLS_SESSION_RTC
+    uint8_t session[TLS_SESSION_BYTES];
+#endif
+};
+
+// State that has to outlive deep sleep. RTC user memory is kept across
+// sleep and resets but not power loss; blocks 0..31 are used by the OTA
+// updater, so ours starts at block 32 and may use the remaining 384 bytes.
+// The ring takes what the other fields leave, see RTC_RING_SIZE.
+template <size_t RING>
+struct RtcLayout {
+    uint32_t crc;
+    uint32_t magic;
+    uint64_t bootClockMs;      // device clock at this boot's millis() == 0
+    uint64_t savedClockMs;     // device clock at the last save
+    uint32_t sequence;         // incremented for every report cycle
+    uint32_t lastSendSec;      // device clock of the last successful send
+    uint16_t wifiFailures;     // consecutive, reset on success
+    uint16_t wifiSkips;        // coming wakes that leave the radio off after them
+    uint16_t sendFailures;
+    uint16_t sensorFailures;   // samples or fault wakes without a valid reading
+    uint8_t  radioOff;         // this wake was started with WAKE_RF_DISABLED
+    uint8_t  uploadWake;       // woken only to send what the last wake queued
+    uint32_t droppedSamples;   // overwritten in the ring before upload
+    uint32_t uploadSequence;   // incremented for every message sent
+    uint32_t suppressedSamples; // inside the deadband, never queued
+    uint32_t spillPending;     // records waiting in the flash spill log
+    WiFiCache wifiCache;
+    ClockSync clock;
+    HealthState health;
+#if TLS
+    TlsCache tls;
+#endif
+    DeadbandState deadband;
+#if ADAPTIVE_INTERVAL
+    AdaptiveState adaptive;
+#endif
+#if REMOTE_CONFIG
+    RuntimeConfig config;      // copy of the flash config, set on a cold boot
+#endif
+#if OTA
+    uint32_t otaDueSec;        // device clock of the next update check, 0 on a cold boot
+#endif
+    SampleRing<RING> samples;
+};
+
+static constexpr size_t RTC_DATA_BYTES = 384;
+
+// The largest ring up to RTC_BUFFER_SIZE records that fits, so sensors or
+// features that grow the record or the other fields shorten the ring
+// instead of breaking the build.
+template <size_t N>
+constexpr size_t fittingRing() {
+    if constexpr (N <= 1 || sizeof(RtcLayout<N>) <= RTC_DATA_BYTES) return N;
+    else return fittingRing<N - 1>();
+}
+
+static constexpr size_t RTC_RING_SIZE = fittingRing<RTC_BUFFER_SIZE>();
+typedef RtcLayout<RTC_RING_SIZE> RtcData;
+
+class RtcState {
+public:
+    static constexpr uint32_t MAGIC        = 0xA3B1E280;
+    static constexpr uint32_t BLOCK_OFFSET = 32;
+
+    static_assert(sizeof(RtcData) % 4 == 0, "RTC memory is accessed in 4-byte blocks");
+    static_assert(RTC_DATA_BYTES == 512 - BLOCK_OFFSET * 4, "RTC_DATA_BYTES is what follows our block offset");
+    static_assert(sizeof(RtcData) <= RTC_DATA_BYTES, "RtcData does not fit in RTC user memory");
+
+    RtcData data;
+
+    // Returns false (and starts from a zeroed block) on a cold boot or
+    // when the stored copy is corrupt. Only a deep-sleep wake has its
+    // clock set ahead by deepSleep(); after any other reset the clock
+    // resumes from the last save, losing the time since then but never
+    // going back.
+    bool load() {
+        if (ESP.rtcUserMemoryRead(BLOCK_OFFSET, reinterpret_cast<uint32_t*>(&data), sizeof(data)) &&
+            data.magic == MAGIC && data.crc == checksum()) {
+            if (ESP.getResetInfoPtr()->reason != REASON_DEEP_SLEEP_AWAKE) data.bootClockMs = data.savedClockMs;
+            return true;
+        }
+
+        memset(&data, 0, sizeof(data));
+        data.magic = MAGIC;
+        return false;
+    }
+
+    void save() {
+        data.savedClockMs = nowMs();
+        data.crc = checksum();
+        ESP.rtcUserMemoryWrite(BLOCK_OFFSET, reinterpret_cast<uint32_t*>(&data), sizeof(data));
+    }
+
+    // millis() is 32-bit on the ESP8266 and wraps after 49.7 days, which an
+    // always-on node gets to.
+    uint64_t nowMs() const { return data.bootClockMs + micros64() / 1000; }
+    uint32_t nowSec() const { return (uint32_t)(nowMs() / 1000); }
+
+    bool clockSynced() const { return data.clock.valid; }
+
+    // Unix time once synced, otherwise the device clock.
+    uint64_t wallMs() const { return nowMs() + (uint64_t)data.clock.offsetSec * 1000; }
+
+    // Unix time of a device-clock second; only meaningful once synced.
+    uint32_t epochSec(uint32_t deviceSec) const { return deviceSec + data.clock.offsetSec; }
+
+    // Until the sleep drift has been measured once, the next sync comes as
+    // soon as there has been enough sleep to measure it.
+    bool syncDue(uint32_t resyncSec) const {
+        const ClockSync& c = data.clock;
+        if (!c.valid) return true;
+        if (!c.driftMeasured && c.sleptMs >= DRIFT_MIN_SLEPT_MS) return true;
+        return nowSec() - c.syncedAtSec >= resyncSec;
+    }
+
+    // Steps the clock to an SNTP answer. After long enough asleep, the
+    // error built up since the last sync is put down to the sleep timer
+    // and corrects its drift estimate. The first sync sets the offset; a
+    // later one moves the device clock forward by the error, so records
+    // queued before it keep their Unix time. Only a clock that ran fast
+    // takes whole seconds off the offset, since the device clock never
+    // goes back and record deltas stay positive.
+    void applySync(uint64_t unixMs) {
+        ClockSync& c = data.clock;
+        int64_t errorMs = (int64_t)(unixMs - wallMs());
+        if (c.valid && c.sleptMs >= DRIFT_MIN_SLEPT_MS) {
+            int64_t ppm = c.sleepDriftPpm + errorMs * 1000000 / c.sleptMs;
+            c.sleepDriftPpm = (int32_t)(ppm > DRIFT_MAX_PPM ? DRIFT_MAX_PPM : ppm < -DRIFT_MAX_PPM ? -DRIFT_MAX_PPM : ppm);
+            c.driftMeasured = 1;
+        }
+
+        int64_t stepSec = errorMs >= 0 ? (c.valid ? 0 : errorMs / 1000) : -((999 - errorMs) / 1000);
+        c.offsetSec += (uint32_t)stepSec;
+        data.bootClockMs += (uint64_t)(errorMs - stepSec * 1000);
+        c.syncedAtSec = nowSec();
+        c.sleptMs = 0;
+        c.valid = 1;
+    }
+
+    // Advances the device clock past the sleep period, persists the state
+    // and powers down. The timer request is corrected by the measured
+    // drift so the wake lands on time. Needs GPIO16 wired to RST to wake
+    // up again.
+    void deepSleep(uint32_t sleepMs, RFMode mode = RF_DEFAULT) {
+        data.bootClockMs = nowMs() + sleepMs;
+        data.clock.sleptMs = sleepMs < UINT32_MAX - data.clock.sleptMs ? data.clock.sleptMs + sleepMs : UINT32_MAX;
+        data.radioOff = mode == RF_DISABLED;
+        save();
+        ESP.deepSleep((uint64_t)sleepMs * 1000 * 1000000 / (1000000 + data.clock.sleepDriftPpm), mode);
+    }
+
+private:
+    // The RC oscillator behind the sleep timer is good to a few percent;
+    // anything past 10 % is a bad measurement.
+    static constexpr uint32_t DRIFT_MIN_SLEPT_MS = 600000;
+    static constexpr int32_t  DRIFT_MAX_PPM      = 100000;
+
+    // Seeded with FIRMWARE_VERSION: another firmware may lay the block out
+    // differently, so the first boot after an update starts cold.
+    uint32_t checksum() const {
+        static const uint32_t seed = crc32(FIRMWARE_VERSION, sizeof(FIRMWARE_VERSION) - 1);
+        return crc32(reinterpret_cast<const uint8_t*>(&data) + sizeof(data.crc), sizeof(data) - sizeof(data.crc), seed);
+    }
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <Arduino.h>
+#include "main.h"
+#include "channels.h"
+
+// Min, max and standard deviation of one channel over a WINDOW_STATS
+// window, in the channel's scale. They describe the filtered values of
+// the window's STATS_READINGS bursts, not single reads. For 32-bit channels min and max are
+// relative to the mean, which keeps them in 16 bits.
+struct ChannelSpread {
+    int16_t  min;
+    int16_t  max;
+    uint16_t std;
+};
+
+// One report, scaled to integers so it packs into RTC memory: 12 bytes
+// for a single BME280, 32 with WINDOW_STATS. SensorRegistry maps channels
+// to their value slots and does the scaling.
+struct PackedSample {
+    ChannelValues values;
+    uint16_t deltaSec;      // seconds after the previous record
+    uint16_t missing;       // bit per channel without a valid value
+#if WINDOW_STATS
+    uint16_t count;         // filtered bursts of the first channel in the window
+    ChannelSpread spread[CHANNEL_COUNT];
+#endif
+
+    bool hasChannel(size_t ch) const { return !(missing & (1u << ch)); }
+};
+
+static constexpr size_t PACKED_SAMPLE_FIELDS =
+    sizeof(ChannelValues) + 4 + (WINDOW_STATS ? 2 + sizeof(ChannelSpread) * CHANNEL_COUNT : 0);
+static_assert(sizeof(PackedSample) == (PACKED_SAMPLE_FIELDS + 3) / 4 * 4, "PackedSample layout changed");
+
+// Sequential reader over the records of one upload, so a batch can be
+// rendered straight from where it is stored. The body is walked twice,
+// once to size it, so rewind() must restart at the first record.
+class SampleSource {
+public:
+    virtual void rewind() = 0;
+    virtual bool next(PackedSample& out) = 0;
+
+protected:
+    ~SampleSource() {}
+};
+
+// Samples handed to DataSender::sendBatch().
+struct SampleBatch {
+    SampleSource* source;
+    size_t   count;
+    uint32_t firstAgeSec;   // age of samples[0] at send time
+    uint32_t firstUnixSec;  // its Unix time, 0 before the first clock sync
+    uint32_t sequence;      // upload sequence number, +1 per message
+};
+
+// Fixed-size FIFO that overwrites the oldest record when full. Timestamps
+// are stored as deltas against the previous record, with the absolute
+// device-clock time kept only for the oldest one. Plain data so it can
+// live inside RtcData.
+template <size_t N>
+struct SampleRing {
+    static_assert(N > 0 && N <= 0xFFFF, "SampleRing size out of range");
+
+    uint32_t firstSec;
+    uint32_t lastSec;
+    uint16_t head;
+    uint16_t count;
+    PackedSample records[N];
+
+    static constexpr size_t capacity() { return N; }
+    size_t size() const { return count; }
+    bool empty() const  { return count == 0; }
+    bool full() const   { return count == N; }
+
+    // i == 0 is the oldest record.
+    const PackedSample& at(size_t i) const { return records[(head + i) % N]; }
+
+    // Returns false if the oldest record had to be dropped to make room.
+    bool push(PackedSample s, uint32_t nowSec) {
+        bool dropped = full();
+        if (dropped) popFront(1);
+
+        if (empty()) {
+            firstSec = nowSec;
+            s.deltaSec = 0;
+        } else {
+            uint32_t delta = nowSec - lastSec;
+            s.deltaSec = delta > 0xFFFF ? 0xFFFF : (uint16_t)delta;
+        }
+
+        records[(head + count) % N] = s;
+        lastSec = nowSec;
+        count++;
+        return !dropped;
+    }
+
+    void popFront(size_t n) {
+        if (n > count) n = count;
+        for (size_t i = 0; i < n; i++) {
+            head = (head + 1) % N;
+            count--;
+            if (count) firstSec += records[head].deltaSec;
+        }
+    }
+
+    // Reads the queued records oldest first, in place.
+    class Reader : public SampleSource {
+    public:
+        explicit Reader(const SampleRing& ring) : ring(ring) {}
+
+        void rewind() override { pos = 0; }
+
+        bool next(PackedSample& out) override {
+            if (pos >= ring.size()) return false;
+            out = ring.at(pos++);
+            return true;
+        }
+
+    private:
+        const SampleRing& ring;
+        size_t pos = 0;
+    };
+};
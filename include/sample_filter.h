@@ -0,0 +1,101 @@
+#pragma once
+
+#include <Arduino.h>
+#include "main.h"
+
+// Closed interval of values a channel can physically report.
+struct PlausibleRange {
+    float lo;
+    float hi;
+
+    bool contains(float v) const { return v >= lo && v <= hi; }
+};
+
+// Mean of `count` values from their sum. The integer version rounds half
+// away from zero, like the lroundf() the float path ends in.
+inline float average(float sum, size_t count) { return sum / count; }
+
+inline int32_t average(int32_t sum, size_t count) {
+    int32_t n = (int32_t)count;
+    return sum >= 0 ? (sum + n / 2) / n : -((n / 2 - sum) / n);
+}
+
+// How a SampleFilter combines its readings. Each policy gets the buffer
+// and its fill count (at least two) and may reorder it. Median and trimmed
+// mean keep a single glitch reading from shifting the report.
+struct MeanFilter {
+    template <typename T>
+    static T combine(T* values, size_t count) { return mean(values, 0, count); }
+
+    template <typename T>
+    static T mean(const T* values, size_t from, size_t to) {
+        T sum = 0;
+        for (size_t i = from; i < to; i++) sum += values[i];
+        return average(sum, to - from);
+    }
+};
+
+struct MedianFilter {
+    template <typename T>
+    static T combine(T* values, size_t count) {
+        sort(values, count);
+        size_t mid = count / 2;
+        return count % 2 ? values[mid] : average(values[mid - 1] + values[mid], 2);
+    }
+
+    // Insertion sort: there are a handful of readings.
+    template <typename T>
+    static void sort(T* values, size_t count) {
+        for (size_t i = 1; i < count; i++) {
+            T v = values[i];
+            size_t j = i;
+            for (; j > 0 && values[j - 1] > v; j--) values[j] = values[j - 1];
+            values[j] = v;
+        }
+    }
+};
+
+// Mean with the TRIM lowest and highest values dropped.
+template <size_t TRIM>
+struct TrimmedMeanFilter {
+    template <typename T>
+    static T combine(T* values, size_t count) {
+        MedianFilter::sort(values, count);
+        // Too few readings to trim both ends: fall back to the median band.
+        size_t trim = count > 2 * TRIM ? TRIM : (count - 1) / 2;
+        return MeanFilter::mean(values, trim, count - trim);
+    }
+};
+
+#if FILTER_MODE == FILTER_MEAN
+typedef MeanFilter ConfiguredFilter;
+#elif FILTER_MODE == FILTER_MEDIAN
+typedef MedianFilter ConfiguredFilter;
+#else
+typedef TrimmedMeanFilter<FILTER_TRIM> ConfiguredFilter;
+#endif
+
+// Collects up to N readings of one channel on the stack and combines them
+// per Policy, FILTER_MODE unless given. T is float or, on the FIXED_POINT
+// path, the channel's scaled integer.
+template <size_t N, typename T, typename Policy = ConfiguredFilter>
+class SampleFilter {
+public:
+    void add(T v) {
+        if (count < N) values[count++] = v;
+    }
+
+    size_t size() const { return count; }
+    bool empty() const  { return count == 0; }
+
+    // Only meaningful when something was added. May reorder the buffer.
+    T result() {
+        if (count == 0) return 0;
+        if (N == 1 || count == 1) return values[0];
+        return Policy::combine(values, count);
+    }
+
+private:
+    T values[N];
+    size_t count = 0;
+};
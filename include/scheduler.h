@@ -0,0 +1,76 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Cooperative scheduler over a fixed task table, driven by millis().
+// A task's next deadline advances by its period from the previous
+// deadline rather than from when it actually ran, so a task delayed by a
+// slow neighbour stays on its grid instead of drifting. Slots missed
+// entirely are skipped, not replayed.
+template <size_t N>
+class Scheduler {
+public:
+    typedef void (*TaskFn)();
+
+    struct Task {
+        const char* name;
+        TaskFn fn;
+        uint32_t periodMs;
+        uint32_t nextMs;
+        uint32_t maxRunUs;    // longest run seen, for spotting blocking tasks
+        bool enabled;
+    };
+
+    // Returns the task id, or -1 if the table is full.
+    int add(const char* name, TaskFn fn, uint32_t periodMs, uint32_t firstDelayMs = 0) {
+        if (count == N) return -1;
+        tasks[count] = { name, fn, periodMs, (uint32_t)(millis() + firstDelayMs), 0, true };
+        return count++;
+    }
+
+    // Runs every task whose deadline has passed, in table order.
+    void runDue() {
+        for (size_t i = 0; i < count; i++) {
+            Task& t = tasks[i];
+            uint32_t now = millis();
+            if (!t.enabled || (int32_t)(now - t.nextMs) < 0) continue;
+
+            do {
+                t.nextMs += t.periodMs;
+            } while ((int32_t)(now - t.nextMs) >= 0);
+
+            uint32_t start = micros();
+            t.fn();
+            uint32_t took = micros() - start;
+            if (took > t.maxRunUs) t.maxRunUs = took;
+        }
+    }
+
+    // Time until the given task is due, 0 if it already is.
+    uint32_t msUntil(int id) const {
+        int32_t left = (int32_t)(tasks[id].nextMs - millis());
+        return left > 0 ? (uint32_t)left : 0;
+    }
+
+    // Time until any enabled task is due.
+    uint32_t msUntilNext() const {
+        uint32_t best = UINT32_MAX;
+        for (size_t i = 0; i < count; i++) {
+            if (!tasks[i].enabled) continue;
+            uint32_t left = msUntil((int)i);
+            if (left < best) best = left;
+        }
+        return best;
+    }
+
+    // Moves a task's next deadline; later runs keep its period from there.
+    void reschedule(int id, uint32_t delayMs) { tasks[id].nextMs = millis() + delayMs; }
+    void setPeriod(int id, uint32_t periodMs) { tasks[id].periodMs = periodMs; }
+
+    void setEnabled(int id, bool enabled) { tasks[id].enabled = enabled; }
+    const Task& task(int id) const        { return tasks[id]; }
+
+private:
+    Task tasks[N];
+    size_t count = 0;
+};
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <Arduino.h>
+#include <array>
+#include <tuple>
+#include <utility>
+#include "main.h"
+#include "channels.h"
+#include "sample_buffer.h"
+#include "sample_filter.h"
+#include "stats.h"
+
+// Filtered result of one sweep, per channel in registry order.
+struct SweepResult {
+    SensorValue value[CHANNEL_COUNT];   // only set where count > 0
+    uint8_t count[CHANNEL_COUNT];
+    uint8_t rejected;                   // readings outside the plausible range
+};
+
+// Where one channel of the registry lives in the record.
+struct RegistryChannel {
+    const ChannelInfo* info;
+    uint8_t sensor;     // index of the sensor in the registry
+    bool prefixed;      // field name is "<sensor id>_<channel name>"
+    bool wide;
+    uint8_t slot;
+    int32_t lo;         // plausible range in the stored unit
+    int32_t hi;
+};
+
+// Numbers the channels of S... in order and gives each a 16- or 32-bit
+// value slot per its quantity.
+template <typename... S>
+constexpr std::array<RegistryChannel, (S::CHANNEL_COUNT + ...)> channelLayout() {
+    const ChannelInfo* tables[] = { S::CHANNELS... };
+    uint8_t counts[] = { S::CHANNEL_COUNT... };
+    std::array<RegistryChannel, (S::CHANNEL_COUNT + ...)> layout = {};
+    size_t ch = 0, narrow = 0, wide = 0;
+    for (size_t s = 0; s < sizeof...(S); s++) {
+        for (size_t i = 0; i < counts[s]; i++) {
+            const ChannelInfo* info = &tables[s][i];
+            bool w = formatOf(info->quantity).wide;
+            layout[ch++] = { info, (uint8_t)s, s > 0, w, (uint8_t)(w ? wide++ : narrow++),
+                             storedBound(info->range.lo, info->quantity), storedBound(info->range.hi, info->quantity) };
+        }
+    }
+    return layout;
+}
+
+// The sensors of this node and the channel layout they share with the
+// ring, the flash log and the payload. The sensor types are template
+// arguments, so the layout is fixed at compile time and every sweep calls
+// the drivers directly. A sensor type provides CHANNEL_COUNT, a CHANNELS
+// table, id(), begin(), start() returning the conversion time in us, and
+// read(SensorValue* values), which gets its channels' values prefilled
+// with Reading::NONE and returns false if the device did not answer. A sensor that fails
+// begin(), or stops answering, keeps its channels, which are then reported
+// missing until a later begin() finds it again.
+template <typename... S>
+class SensorRegistry {
+public:
+    typedef RegistryChannel Channel;
+    typedef WindowStats<CHANNEL_COUNT, SensorValue> Window;
+
+    static constexpr size_t SENSORS = sizeof...(S);
+    static constexpr int SAMPLES_PER_REPORT = FORCED_MODE ? 1 : SAMPLE_SIZE;
+    // WINDOW_STATS accumulates short filtered bursts rather than single
+    // reads, so a glitch the filter drops does not reach the window either.
+    // Three is the fewest a median can outvote one bad reading with.
+    static constexpr int STATS_READINGS = SAMPLES_PER_REPORT < 3 ? SAMPLES_PER_REPORT : 3;
+    static constexpr int STATS_BURSTS   = SAMPLES_PER_REPORT / STATS_READINGS;
+    static_assert(SAMPLE_SIZE > 0 && SAMPLE_SIZE <= 0xFF, "SAMPLE_SIZE must fit the uint8_t counts");
+    static_assert(SENSORS <= 8, "downMask() is a uint8_t");
+
+    explicit SensorRegistry(S&... sensors) : devices(sensors...) {
+        static_assert(LAYOUT.size() == CHANNEL_COUNT && countWide() == WIDE_CHANNELS,
+                      "The sensor types do not match BME280_COUNT / SHT3X");
+    }
+
+    // Probes the sensors that are down, so it also serves as the re-probe.
+    // Returns false only if no sensor is up.
+    bool begin() { return beginAll(INDICES); }
+
+    bool allUp() const { return downMask() == 0; }
+
+    // Bit s set for each sensor s that is down.
+    uint8_t downMask() const {
+        uint8_t mask = 0;
+        for (size_t s = 0; s < SENSORS; s++) mask |= !up[s] << s;
+        return mask;
+    }
+
+    // The channels of the sensors in `sensors`, a downMask().
+    static uint16_t channelMask(uint8_t sensors) {
+        uint16_t mask = 0;
+        for (size_t ch = 0; ch < CHANNEL_COUNT; ch++) mask |= (sensors >> LAYOUT[ch].sensor & 1) << ch;
+        return mask;
+    }
+
+    static constexpr size_t size()                     { return CHANNEL_COUNT; }
+    static constexpr const Channel& channel(size_t ch) { return LAYOUT[ch]; }
+    const char* sensorId(size_t ch) const              { return ids[LAYOUT[ch].sensor]; }
+    const char* sensorName(size_t s) const             { return ids[s]; }
+
+    // Takes READINGS readings of every sensor and combines each channel
+    // with Filter; the combined value, not the raw readings, is also fed
+    // to `window`. Every reading starts all conversions, waits once for
+    // the slowest and then collects them, so the sensors convert in
+    // parallel. A sensor that answers none of the readings is taken as
+    // down.
+    template <int READINGS = SAMPLES_PER_REPORT, typename Filter = ConfiguredFilter>
+    SweepResult sample(Window* window = nullptr) {
+        static_assert(READINGS > 0 && READINGS <= SAMPLES_PER_REPORT, "READINGS out of range");
+        SampleFilter<READINGS, SensorValue, Filter> filters[CHANNEL_COUNT];
+        SweepResult result = {};
+        SensorValue values[CHANNEL_COUNT];
+        bool answered[SENSORS] = {};
+
+        for (int i = 0; i < READINGS; i++) {
+            uint32_t waitUs = startAll(INDICES);
+            if (waitUs) delay((waitUs + 999) / 1000);
+
+            for (SensorValue& v : values) v = Reading<SensorValue>::NONE;
+            readAll(values, answered, INDICES);
+
+            for (size_t ch = 0; ch < CHANNEL_COUNT; ch++) {
+                SensorValue v = values[ch];
+                if (!Reading<SensorValue>::present(v)) continue;
+                if (!inRange(ch, v)) {
+                    result.rejected++;
+                    continue;
+                }
+                filters[ch].add(v);
+            }
+
+            if (i + 1 < READINGS) delay(50);
+            yield();
+        }
+
+        for (size_t s = 0; s < SENSORS; s++) {
+            if (!up[s] || answered[s]) continue;
+            up[s] = false;
+            Serial.printf("Sensor %s stopped answering\n", ids[s]);
+        }
+        for (size_t ch = 0; ch < CHANNEL_COUNT; ch++) {
+            result.count[ch] = filters[ch].size();
+            result.value[ch] = filters[ch].result();
+            if (window && result.count[ch]) window->channel[ch].add(result.value[ch]);
+        }
+        return result;
+    }
+
+    static PackedSample pack(const SweepResult& r) {
+        PackedSample s = {};
+        for (size_t ch = 0; ch < CHANNEL_COUNT; ch++) {
+            if (r.count[ch]) setValue(s.values, ch, Reading<SensorValue>::stored(r.value[ch], decimalsOf(ch)));
+            else s.missing |= 1u << ch;
+        }
+        return s;
+    }
+
+    // Means go into the value slots; the spread is clamped to its 16-bit
+    // fields, which only matters for a broken sensor.
+    static PackedSample pack(const Window& w) {
+        PackedSample s = {};
+        for (size_t ch = 0; ch < CHANNEL_COUNT; ch++) {
+            const RunningStats<SensorValue>& st = w.channel[ch];
+            if (!st.count) {
+                s.missing |= 1u << ch;
+                continue;
+            }
+            int32_t mean = meanOf(ch, st);
+            setValue(s.values, ch, mean);
+#if WINDOW_STATS
+            s.spread[ch] = spreadOf(ch, st, mean);
+#endif
+        }
+#if WINDOW_STATS
+        s.count = w.channel[0].count;
+#endif
+        return s;
+    }
+
+    static int32_t value(const ChannelValues& v, size_t ch) {
+        const Channel& c = LAYOUT[ch];
+        return c.wide ? v.wide[c.slot] : v.narrow[c.slot];
+    }
+
+    static void setValue(ChannelValues& v, size_t ch, int32_t x) {
+        const Channel& c = LAYOUT[ch];
+        if (c.wide) v.wide[c.slot] = x;
+        else v.narrow[c.slot] = clampI16(x);
+    }
+
+private:
+    static constexpr std::array<Channel, (S::CHANNEL_COUNT + ...)> LAYOUT = channelLayout<S...>();
+    static constexpr std::index_sequence_for<S...> INDICES = {};
+
+    static constexpr size_t countWide() {
+        size_t n = 0;
+        for (const Channel& c : LAYOUT) n += c.wide;
+        return n;
+    }
+
+    std::tuple<S&...> devices;
+    const char* ids[SENSORS];
+    bool up[SENSORS] = {};
+
+    template <size_t... I>
+    bool beginAll(std::index_sequence<I...>) {
+        (beginOne<I>(), ...);
+        bool any = false;
+        for (bool u : up) any |= u;
+        return any;
+    }
+
+    template <size_t I>
+    void beginOne() {
+        if (up[I]) return;
+        up[I] = std::get<I>(devices).begin();
+        ids[I] = std::get<I>(devices).id();
+        if (!up[I]) Serial.printf("Sensor %s not found\n", ids[I]);
+    }
+
+    template <size_t... I>
+    uint32_t startAll(std::index_sequence<I...>) {
+        uint32_t waitUs = 0;
+        (startOne<I>(waitUs), ...);
+        return waitUs;
+    }
+
+    template <size_t I>
+    void startOne(uint32_t& waitUs) {
+        if (!up[I]) return;
+        uint32_t t = std::get<I>(devices).start();
+        if (t > waitUs) waitUs = t;
+    }
+
+    template <size_t... I>
+    void readAll(SensorValue* values, bool* answered, std::index_sequence<I...>) {
+        (readOne<I>(values, answered), ...);
+    }
+
+    template <size_t I>
+    void readOne(SensorValue* values, bool* answered) {
+        constexpr size_t first = firstChannel(I);
+        if (up[I] && std::get<I>(devices).read(values + first)) answered[I] = true;
+    }
+
+    static constexpr size_t firstChannel(size_t sensor) {
+        size_t ch = 0;
+        while (LAYOUT[ch].sensor != sensor) ch++;
+        return ch;
+    }
+
+    static uint8_t decimalsOf(size_t ch) { return formatOf(LAYOUT[ch].info->quantity).decimals; }
+
+    static bool inRange(size_t ch, float v)   { return LAYOUT[ch].info->range.contains(v); }
+    static bool inRange(size_t ch, int32_t v) { return v >= LAYOUT[ch].lo && v <= LAYOUT[ch].hi; }
+
+    // `v` in units of the channel's last stored decimal.
+    static float scaled(size_t ch, float v, bool spread) {
+        QuantityFormat f = formatOf(LAYOUT[ch].info->quantity);
+        return v * decimalScale(spread ? f.stdDecimals : f.decimals);
+    }
+
+    static int32_t meanOf(size_t ch, const RunningStats<float>& st) { return lroundf(scaled(ch, st.mean, false)); }
+    static int32_t meanOf(size_t, const RunningStats<int32_t>& st)  { return st.mean(); }
+
+    // Pressure min and max are stored relative to the mean.
+    static ChannelSpread spreadOf(size_t ch, const RunningStats<float>& st, int32_t mean) {
+        float base = LAYOUT[ch].wide ? (float)mean : 0.0f;
+        return { toI16(scaled(ch, st.min, false) - base), toI16(scaled(ch, st.max, false) - base),
+                 toU16(scaled(ch, st.stddev(), true)) };
+    }
+
+    static ChannelSpread spreadOf(size_t ch, const RunningStats<int32_t>& st, int32_t mean) {
+        QuantityFormat f = formatOf(LAYOUT[ch].info->quantity);
+        int32_t base = LAYOUT[ch].wide ? mean : 0;
+        uint32_t std = st.stddev(f.stdDecimals > f.decimals ? 10 : 1);
+        return { clampI16(st.min - base), clampI16(st.max - base), (uint16_t)(std > UINT16_MAX ? UINT16_MAX : std) };
+    }
+
+    static int16_t clampI16(int32_t v) { return v < INT16_MIN ? INT16_MIN : v > INT16_MAX ? INT16_MAX : (int16_t)v; }
+
+    static int16_t toI16(float v) {
+        return v <= -32768.0f ? INT16_MIN : v >= 32767.0f ? INT16_MAX : (int16_t)lroundf(v);
+    }
+
+    static uint16_t toU16(float v) {
+        return v <= 0.0f ? 0 : v >= 65535.0f ? UINT16_MAX : (uint16_t)lroundf(v);
+    }
+};
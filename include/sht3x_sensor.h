@@ -0,0 +1,85 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "main.h"
+#include "channels.h"
+
+// Sensirion SHT3x temperature and humidity sensor: one single-shot,
+// high-repeatability measurement per reading, without clock stretching so
+// it cannot hold the bus for the other sensors.
+class Sht3xSensor {
+public:
+    explicit Sht3xSensor(uint8_t addr = 0x44) : addr(addr) {
+        snprintf(idBuf, sizeof(idBuf), "sht3x_%02x", addr);
+    }
+
+    static constexpr uint8_t CHANNEL_COUNT = 2;
+    static constexpr ChannelInfo CHANNELS[CHANNEL_COUNT] = {
+        { "temperature", Quantity::TEMPERATURE, { -40.0f, 125.0f } },
+        { "humidity",    Quantity::HUMIDITY,    { 0.0f, 100.0f } },
+    };
+
+    const char* id() const { return idBuf; }
+
+    // The chip has no ID register; a soft reset it acknowledges will do.
+    bool begin() {
+        if (!command(CMD_SOFT_RESET)) return false;
+        delay(2);
+        return true;
+    }
+
+    // A measurement that was not acknowledged is not read back, so a
+    // missing chip costs one NACK per reading rather than two.
+    uint32_t start() {
+        measuring = command(CMD_MEASURE_HIGH);
+        return measuring ? CONVERSION_US : 0;
+    }
+
+    bool read(SensorValue* values) {
+        if (!measuring) return false;
+        measuring = false;
+        uint8_t buf[6];
+        if (Wire.requestFrom(addr, (uint8_t)sizeof(buf)) != sizeof(buf)) return false;
+        for (uint8_t& b : buf) b = Wire.read();
+
+        // Each word carries its own CRC; a bad one only voids that channel.
+        if (crc8(buf, 2) == buf[2]) convertTemperature(be16(buf), values[0]);
+        if (crc8(buf + 3, 2) == buf[5]) convertHumidity(be16(buf + 3), values[1]);
+        return true;
+    }
+
+    // Datasheet 4.13, in degC / %RH or as 0.01 degC / 0.01 %RH integers.
+    static void convertTemperature(uint16_t raw, float& out)   { out = -45.0f + 175.0f * raw / 65535.0f; }
+    static void convertHumidity(uint16_t raw, float& out)      { out = 100.0f * raw / 65535.0f; }
+    static void convertTemperature(uint16_t raw, int32_t& out) { out = -4500 + (int32_t)((17500ul * raw + 32767) / 65535); }
+    static void convertHumidity(uint16_t raw, int32_t& out)    { out = (int32_t)((10000ul * raw + 32767) / 65535); }
+
+private:
+    static constexpr uint16_t CMD_MEASURE_HIGH = 0x2400;
+    static constexpr uint16_t CMD_SOFT_RESET   = 0x30A2;
+    static constexpr uint32_t CONVERSION_US    = 15500;   // datasheet maximum, high repeatability
+
+    uint8_t addr;
+    bool measuring = false;
+    char idBuf[9];
+
+    bool command(uint16_t cmd) {
+        Wire.beginTransmission(addr);
+        Wire.write((uint8_t)(cmd >> 8));
+        Wire.write((uint8_t)cmd);
+        return Wire.endTransmission() == 0;
+    }
+
+    static uint16_t be16(const uint8_t* p) { return (uint16_t)(p[0] << 8 | p[1]); }
+
+    // Datasheet 4.12: polynomial 0x31, initial value 0xFF.
+    static uint8_t crc8(const uint8_t* p, size_t n) {
+        uint8_t crc = 0xFF;
+        while (n--) {
+            crc ^= *p++;
+            for (uint8_t i = 0; i < 8; i++) crc = crc & 0x80 ? (crc << 1) ^ 0x31 : crc << 1;
+        }
+        return crc;
+    }
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include "main.h"
+
+// One-shot SNTP query (RFC 4330) over a plain UDP socket. The core's
+// background sntp client polls on its own schedule and needs wall time
+// in libc; a deep-sleep wake only wants one answer while the radio is up
+// anyway, and the device clock lives in RTC memory.
+class SntpClient {
+public:
+    explicit SntpClient(const char* host) : host(host) {}
+
+    // Returns false without an answer within NTP_TIMEOUT_MS. On success
+    // `unixMs` is the time at return, the server's transmit time plus half
+    // the round trip.
+    bool query(uint64_t& unixMs) {
+        IPAddress server;
+        if (WiFi.hostByName(host, server, CONNECT_TIMEOUT_MS) != 1) {
+            Serial.printf("DNS lookup for %s failed\n", host);
+            return false;
+        }
+
+        // Mode 3 (client), version 4. The transmit timestamp is only a
+        // nonce the server echoes as originate timestamp.
+        uint8_t packet[PACKET_SIZE] = {};
+        packet[0] = 0x23;
+        uint32_t nonce = micros();
+        put32(packet + 44, nonce);
+
+        udp.begin(0);
+        unsigned long sentMs = millis();
+        bool ok = udp.beginPacket(server, PORT) && udp.write(packet, sizeof(packet)) == sizeof(packet) &&
+                  udp.endPacket();
+        while (ok && millis() - sentMs < NTP_TIMEOUT_MS) {
+            if (udp.parsePacket() >= (int)sizeof(packet) && udp.remoteIP() == server) {
+                udp.read(packet, sizeof(packet));
+                if (valid(packet, nonce)) {
+                    unsigned long rttMs = millis() - sentMs;
+                    uint64_t seconds = (uint32_t)(get32(packet + 40) - NTP_TO_UNIX_SEC);
+                    uint64_t fractionMs = ((uint64_t)get32(packet + 44) * 1000) >> 32;
+                    unixMs = seconds * 1000 + fractionMs + rttMs / 2;
+                    udp.stop();
+                    return true;
+                }
+            }
+            delay(1);
+        }
+        udp.stop();
+        Serial.printf("No SNTP answer from %s\n", host);
+        return false;
+    }
+
+private:
+    static constexpr uint16_t PORT            = 123;
+    static constexpr size_t   PACKET_SIZE     = 48;
+    static constexpr uint32_t NTP_TO_UNIX_SEC = 2208988800ul;   // 1900 to 1970
+
+    WiFiUDP udp;
+    const char* host;
+
+    // A server answer to our request from a synchronised server.
+    static bool valid(const uint8_t* p, uint32_t nonce) {
+        uint8_t mode = p[0] & 0x07;
+        uint8_t leap = p[0] >> 6;
+        uint8_t stratum = p[1];
+        return mode == 4 && leap != 3 && stratum >= 1 && stratum <= 15 && get32(p + 28) == nonce &&
+               get32(p + 40) != 0;
+    }
+
+    static uint32_t get32(const uint8_t* p) {
+        return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+    }
+
+    static void put32(uint8_t* p, uint32_t v) {
+        p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+    }
+};
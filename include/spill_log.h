@@ -0,0 +1,234 @@
+#pragma once
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "main.h"
+#include "sample_buffer.h"
+
+// One spilled report with its absolute device-clock time.
+struct SpillRecord {
+    uint32_t sec;
+    PackedSample sample;
+};
+
+static_assert(sizeof(SpillRecord) == 4 + sizeof(PackedSample), "SpillRecord must stay packed");
+
+// Append-only report log in LittleFS for outages longer than the RTC ring
+// covers. Records go into segment files of SPILL_SEGMENT_RECORDS records,
+// named by an increasing id. Segments are never rewritten: a replayed one
+// is deleted, and once SPILL_MAX_SEGMENTS exist the oldest is dropped to
+// make room. Each new segment therefore lands in freshly allocated blocks,
+// which keeps flash wear spread. The replay cursor (segment id and record
+// index) lives in a small file that is rewritten once per consumed chunk,
+// so replay resumes where it stopped even after a power loss.
+class SpillLog {
+public:
+    // Mounts the filesystem and scans the segments. Cheap once mounted.
+    bool begin() {
+        if (mounted) return true;
+        if (!LittleFS.begin()) {
+            Serial.println("LittleFS mount failed, spill log disabled.");
+            return false;
+        }
+        mounted = true;
+        LittleFS.mkdir(DIR);
+        scan();
+        return true;
+    }
+
+    size_t pending() const    { return count; }
+    uint32_t dropped() const  { return droppedRecords; }
+
+    bool append(const PackedSample& s, uint32_t sec) {
+        if (tailCount >= SPILL_SEGMENT_RECORDS) startSegment();
+
+        SpillRecord rec = { sec, s };
+        File f = LittleFS.open(path(tailId), "a");
+        if (!f) return false;
+        bool ok = f.write(reinterpret_cast<const uint8_t*>(&rec), sizeof(rec)) == sizeof(rec);
+        f.close();
+        if (!ok) return false;
+
+        tailCount++;
+        count++;
+        return true;
+    }
+
+    // Up to `max` records from the cursor, read from flash as the upload
+    // is written rather than copied into RAM. deltaSec is relative to the
+    // previous record. A chunk never crosses a segment boundary.
+    class Chunk : public SampleSource {
+    public:
+        size_t size() const       { return count; }
+        uint32_t firstSec() const { return first; }
+
+        void rewind() override {
+            file.seek(start * sizeof(SpillRecord));
+            left = count;
+            prevSec = first;
+        }
+
+        bool next(PackedSample& out) override {
+            SpillRecord rec;
+            if (!left || file.read(reinterpret_cast<uint8_t*>(&rec), sizeof(rec)) != (int)sizeof(rec)) return false;
+            left--;
+            uint32_t delta = rec.sec - prevSec;
+            rec.sample.deltaSec = delta > 0xFFFF ? 0xFFFF : (uint16_t)delta;
+            prevSec = rec.sec;
+            out = rec.sample;
+            return true;
+        }
+
+        void close() { file.close(); }
+
+    private:
+        friend class SpillLog;
+        File file;
+        size_t start = 0;
+        size_t count = 0;
+        size_t left = 0;
+        uint32_t first = 0;
+        uint32_t prevSec = 0;
+    };
+
+    // Returns the number of records in the chunk, 0 if there are none.
+    size_t open(Chunk& chunk, size_t max) {
+        skipFinishedSegments();
+
+        size_t avail = recordsIn(cursorId);
+        avail = avail > cursorIndex ? avail - cursorIndex : 0;
+        chunk.file = LittleFS.open(path(cursorId), "r");
+        SpillRecord rec;
+        if (!avail || !chunk.file || !chunk.file.seek(cursorIndex * sizeof(SpillRecord)) ||
+            chunk.file.read(reinterpret_cast<uint8_t*>(&rec), sizeof(rec)) != (int)sizeof(rec)) {
+            chunk.close();
+            return chunk.count = 0;
+        }
+
+        chunk.start = cursorIndex;
+        chunk.count = avail < max ? avail : max;
+        chunk.first = rec.sec;
+        chunk.rewind();
+        return chunk.count;
+    }
+
+    // Marks the records of the last opened chunk as delivered.
+    void consume(size_t n) {
+        cursorIndex += n;
+        count = count > n ? count - n : 0;
+
+        if (cursorId == tailId && cursorIndex >= tailCount) {
+            // Fully replayed: drop the tail too and start over empty.
+            LittleFS.remove(path(tailId));
+            cursorId = headId = ++tailId;
+            cursorIndex = tailCount = 0;
+            count = 0;
+        } else {
+            skipFinishedSegments();
+        }
+        writeCursor();
+    }
+
+private:
+    static constexpr const char* DIR    = "/spill";
+    static constexpr const char* CURSOR = "/spill/cursor";
+
+    bool mounted = false;
+    uint32_t headId = 1;        // oldest segment still on flash
+    uint32_t tailId = 1;        // segment being appended to
+    uint32_t tailCount = 0;
+    uint32_t cursorId = 1;
+    uint32_t cursorIndex = 0;
+    size_t count = 0;           // records not yet replayed
+    uint32_t droppedRecords = 0;
+
+    static String path(uint32_t id) {
+        char name[20];
+        snprintf(name, sizeof(name), "%s/%08x", DIR, (unsigned)id);
+        return String(name);
+    }
+
+    size_t recordsIn(uint32_t id) const {
+        if (id == tailId) return tailCount;
+        File f = LittleFS.open(path(id), "r");
+        size_t n = f ? f.size() / sizeof(SpillRecord) : 0;
+        f.close();
+        return n;
+    }
+
+    void scan() {
+        bool any = false;
+        uint32_t lowest = 0, highest = 0;
+        Dir dir = LittleFS.openDir(DIR);
+        while (dir.next()) {
+            char* end;
+            uint32_t id = strtoul(dir.fileName().c_str(), &end, 16);
+            if (*end || id == 0) continue;
+            if (!any || id < lowest) lowest = id;
+            if (!any || id > highest) highest = id;
+            any = true;
+        }
+        if (!any) return;
+
+        headId = lowest;
+        tailId = highest;
+        File tail = LittleFS.open(path(tailId), "r");
+        size_t tailSize = tail ? tail.size() : 0;
+        tail.close();
+        tailCount = tailSize / sizeof(SpillRecord);
+        // A torn final write would misalign further appends.
+        if (tailSize % sizeof(SpillRecord)) startSegment();
+
+        readCursor();
+        count = 0;
+        for (uint32_t id = cursorId; id <= tailId; id++) count += recordsIn(id);
+        count -= cursorIndex < count ? cursorIndex : count;
+    }
+
+    void startSegment() {
+        if (tailId - headId + 1 >= SPILL_MAX_SEGMENTS) dropOldest();
+        tailId++;
+        tailCount = 0;
+    }
+
+    void dropOldest() {
+        size_t lost = headId == cursorId ? recordsIn(headId) - cursorIndex : 0;
+        LittleFS.remove(path(headId));
+        if (cursorId == headId) {
+            cursorId++;
+            cursorIndex = 0;
+            writeCursor();
+        }
+        headId++;
+        count -= lost < count ? lost : count;
+        droppedRecords += lost;
+    }
+
+    void skipFinishedSegments() {
+        while (cursorId < tailId && cursorIndex >= recordsIn(cursorId)) {
+            LittleFS.remove(path(cursorId));
+            cursorId = headId = cursorId + 1;
+            cursorIndex = 0;
+        }
+    }
+
+    void readCursor() {
+        uint32_t cur[2] = { headId, 0 };
+        File f = LittleFS.open(CURSOR, "r");
+        if (f) {
+            f.read(reinterpret_cast<uint8_t*>(cur), sizeof(cur));
+            f.close();
+        }
+        if (cur[0] < headId || cur[0] > tailId) cur[0] = headId, cur[1] = 0;
+        cursorId = cur[0];
+        cursorIndex = cur[1];
+    }
+
+    void writeCursor() {
+        uint32_t cur[2] = { cursorId, cursorIndex };
+        File f = LittleFS.open(CURSOR, "w");
+        if (!f) return;
+        f.write(reinterpret_cast<const uint8_t*>(cur), sizeof(cur));
+        f.close();
+    }
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Mean, variance, min and max of a stream of values in constant space.
+// All zeroes is a valid empty state, so static instances need no setup.
+template <typename T> struct RunningStats;
+
+// Welford's online algorithm.
+template <> struct RunningStats<float> {
+    uint16_t count;
+    float mean;
+    float m2;
+    float min;
+    float max;
+
+    void reset() { *this = RunningStats(); }
+
+    void add(float x) {
+        if (count == 0xFFFF) return;
+        count++;
+        float delta = x - mean;
+        mean += delta / count;
+        m2 += delta * (x - mean);
+        if (count == 1 || x < min) min = x;
+        if (count == 1 || x > max) max = x;
+    }
+
+    // Sample variance; 0 until there are two values.
+    float variance() const { return count > 1 ? m2 / (count - 1) : 0.0f; }
+    float stddev() const   { return sqrtf(variance()); }
+};
+
+// Integer sums for the FIXED_POINT path. Values are summed relative to the
+// first one, which keeps the squares small for a steady channel.
+template <> struct RunningStats<int32_t> {
+    uint16_t count;
+    int32_t first;
+    int32_t min;
+    int32_t max;
+    int64_t sum;
+    int64_t sumSq;
+
+    void reset() { *this = RunningStats(); }
+
+    void add(int32_t x) {
+        if (count == 0xFFFF) return;
+        if (count == 0) first = min = max = x;
+        count++;
+        int64_t d = (int64_t)x - first;
+        sum += d;
+        sumSq += d * d;
+        if (x < min) min = x;
+        if (x > max) max = x;
+    }
+
+    // Rounded half away from zero.
+    int32_t mean() const {
+        if (!count) return 0;
+        int64_t half = count / 2;
+        return first + (int32_t)(sum >= 0 ? (sum + half) / count : -((half - sum) / count));
+    }
+
+    // Sample standard deviation times `scale`, rounded; 0 until there are
+    // two values. Saturates where the sums would overflow, which takes
+    // readings spread over most of the sensor's range.
+    uint32_t stddev(uint32_t scale) const {
+        if (count < 2) return 0;
+        if (sum > 3000000000ll || sum < -3000000000ll) return UINT32_MAX;
+        int64_t spread = sumSq - sum * sum / count;   // (n - 1) * variance
+        if (spread <= 0) return 0;
+        uint64_t scaledVar = (uint64_t)spread * scale * scale / (count - 1);
+        return (isqrt(scaledVar * 4) + 1) / 2;
+    }
+
+private:
+    // floor(sqrt(v)), bit by bit.
+    static uint32_t isqrt(uint64_t v) {
+        uint64_t root = 0;
+        uint64_t bit = 1ull << 62;
+        while (bit > v) bit >>= 2;
+        while (bit) {
+            if (v >= root + bit) {
+                v -= root + bit;
+                root = (root >> 1) + bit;
+            } else {
+                root >>= 1;
+            }
+            bit >>= 2;
+        }
+        return (uint32_t)root;
+    }
+};
+
+// Per-channel statistics for one reporting window.
+template <size_t N, typename T>
+struct WindowStats {
+    RunningStats<T> channel[N];
+
+    void reset() {
+        for (RunningStats<T>& c : channel) c.reset();
+    }
+
+    bool empty() const {
+        for (const RunningStats<T>& c : channel)
+            if (c.count) return false;
+        return true;
+    }
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <Arduino.h>
+#include "body_stream.h"
+
+// Delivers one serialized payload to the backend. DataSender owns the
+// payload format; a transport only moves bytes and reports success. The
+// body arrives as a stream of known length, generated while it is sent.
+// `sequence` is the message's upload sequence number, which is also
+// embedded in the payload.
+class Transport {
+public:
+    virtual ~Transport() {}
+
+    virtual const char* name() const = 0;
+    virtual bool send(BodyStream& body, const char* contentType, uint32_t sequence) = 0;
+
+    // Called from loop() for transports that keep a session alive.
+    virtual void maintain() {}
+    virtual void stop() {}
+
+    // Extra attempts made inside send() since boot, for diagnostics.
+    virtual uint32_t retries() const { return 0; }
+
+    // What the backend sent back since the last call, e.g. a config
+    // block, copied to `buf` without a terminator; 0 if nothing came.
+    virtual size_t takeReply(char* buf, size_t capacity) {
+        (void)buf;
+        (void)capacity;
+        return 0;
+    }
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include "main.h"
+#include "transport.h"
+
+// Sends each payload as a single datagram, for dense deployments where an
+// occasional lost point is acceptable but TCP + HTTP radio time is not.
+// Every message carries the RTC upload sequence number, so the server can
+// spot gaps. With UDP_ACK the server is expected to answer with the
+// 4-byte little-endian sequence number; only then does the send count as
+// delivered and the samples leave the ring. Without it a datagram that
+// made it into the lwIP queue counts as sent.
+class UdpTransport : public Transport {
+public:
+    // Largest payload that fits an unfragmented datagram on a 1500-byte MTU.
+    static constexpr size_t MAX_DATAGRAM = 1472;
+
+    UdpTransport(const char* host, uint16_t port) : host(host), port(port) {}
+
+    const char* name() const override { return "udp"; }
+
+    bool send(BodyStream& body, const char* contentType, uint32_t sequence) override {
+        (void)contentType;
+        size_t len = body.length();
+        if (len > MAX_DATAGRAM) {
+            Serial.printf("Payload of %u bytes does not fit a datagram\n", (unsigned)len);
+            return false;
+        }
+        if (!resolve()) return false;
+
+        if (!started) {
+            udp.begin(0);
+            started = true;
+        }
+
+        if (!udp.beginPacket(serverIp, port) || body.writeTo(udp) != len || !udp.endPacket()) {
+            Serial.println("UDP send failed");
+            return false;
+        }
+
+        if (!UDP_ACK) {
+            // endPacket() only queues the frame; give the driver a moment
+            // to put it on air before a deep sleep cuts the radio.
+            delay(TX_SETTLE_MS);
+            return true;
+        }
+        return waitForAck(sequence);
+    }
+
+    void stop() override {
+        if (started) udp.stop();
+        started = false;
+    }
+
+private:
+    static constexpr uint8_t TX_SETTLE_MS = 10;
+
+    WiFiUDP udp;
+    const char* host;
+    uint16_t port;
+    IPAddress serverIp;
+    bool resolved = false;
+    bool started = false;
+
+    bool resolve() {
+        if (resolved) return true;
+        resolved = WiFi.hostByName(host, serverIp, CONNECT_TIMEOUT_MS) == 1;
+        if (!resolved) Serial.printf("DNS lookup for %s failed\n", host);
+        return resolved;
+    }
+
+    bool waitForAck(uint32_t sequence) {
+        unsigned long start = millis();
+        while (millis() - start < UDP_ACK_TIMEOUT_MS) {
+            if (udp.parsePacket() >= 4) {
+                uint8_t ack[4];
+                udp.read(ack, sizeof(ack));
+                uint32_t acked = ack[0] | (ack[1] << 8) | (ack[2] << 16) | ((uint32_t)ack[3] << 24);
+                if (udp.remoteIP() == serverIp && acked == sequence) return true;
+            }
+            delay(1);
+        }
+        Serial.printf("No ack for UDP message %u\n", sequence);
+        return false;
+    }
+};
@@ -1,166 +1,1263 @@
 #include <Arduino.h>
 #include <Wire.h>
-#include <Adafruit_BME280.h>
 #include <ESP8266WiFi.h>
-#include <ESP8266HTTPClient.h>
 #include <array>
 #include "main.h"
+#include "bme280_sensor.h"
+#include "diagnostics.h"
+#include "health.h"
+#include "rtc_state.h"
+#include "payload_writer.h"
+#include "scheduler.h"
+#include "sensor_registry.h"
+#include "transport.h"
+#if SHT3X
+#include "sht3x_sensor.h"
+#endif
+#if TRANSPORT == TRANSPORT_MQTT
+#include "mqtt_transport.h"
+#elif TRANSPORT == TRANSPORT_UDP
+#include "udp_transport.h"
+#else
+#include "http_transport.h"
+#endif
+#if SPILL_LOG
+#include "spill_log.h"
+#endif
+#if TIME_SYNC
+#include "sntp_client.h"
+#endif
+#if OTA
+#include "ota_updater.h"
+#endif
 
+Diagnostics diag;
+
+// Non-blocking connection state machine. The SDK events only raise flags;
+// all transitions happen in update(), which returns immediately so the
+// rest of loop() keeps running while the link comes up. Failed attempts
+// back off exponentially between backoffMin and backoffMax.
+//
+// With WIFI_FAST_CONNECT the first attempt reuses the cached BSSID,
+// channel and lease as a static config, which skips the scan and DHCP.
+// If that does not come up within WIFI_FAST_TIMEOUT_MS the cache is
+// dropped and a regular scan + DHCP attempt follows straight away.
 class WiFiManager {
 public:
-    WiFiManager(const char* ssid, const char* pass, unsigned long timeout)
-        : ssid(ssid), pass(pass), timeout(timeout), lastAttempt(0) {}
+    enum class State : uint8_t { IDLE, CONNECTING, CONNECTED, BACKOFF };
 
-    void update() {
-        if (WiFi.status() == WL_CONNECTED) return;
+    WiFiManager(const char* ssid, const char* pass, unsigned long timeout,
+                unsigned long backoffMin, unsigned long backoffMax, WiFiCache& cache)
+        : ssid(ssid), pass(pass), timeout(timeout),
+          backoffMin(backoffMin), backoffMax(backoffMax), backoff(backoffMin), cache(cache) {}
 
+    void begin() {
+        // Credentials come from build flags; don't rewrite them to flash
+        // on every WiFi.begin().
+        WiFi.persistent(false);
+        WiFi.mode(WIFI_STA);
+        WiFi.setAutoReconnect(false);
+
+        gotIpHandler = WiFi.onStationModeGotIP([this](const WiFiEventStationModeGotIP&) { gotIp = true; });
+        disconnectedHandler = WiFi.onStationModeDisconnected(
+            [this](const WiFiEventStationModeDisconnected&) { linkLost = true; });
+    }
+
+    void update() {
         unsigned long now = millis();
-        if (now - lastAttempt < timeout) return;
 
-        lastAttempt = now;
-        Serial.printf("Connecting to Wi-Fi: %s\n", ssid);
-        WiFi.begin(ssid, pass);
+        switch (state) {
+        case State::IDLE:
+            startAttempt(now);
+            break;
 
-        unsigned long start = millis();
-        while (WiFi.status() != WL_CONNECTED && millis() - start < timeout) {
-            delay(200);
-            Serial.print(".");
+        case State::CONNECTING:
+            if (gotIp || WiFi.status() == WL_CONNECTED) {
+                state = State::CONNECTED;
+                diag.wifi.record(micros() - attemptStartUs);
+                backoff = backoffMin;
+                linkLost = false;
+                Serial.printf("Wi-Fi connected in %lu ms%s, IP Address: %s\n", now - stateSince,
+                              fastAttempt ? " (fast)" : "", WiFi.localIP().toString().c_str());
+                storeCache();
+            } else if (now - stateSince >= attemptTimeout() || attemptRejected()) {
+                WiFi.disconnect();
+                diag.wifiFailures++;
+                if (fastAttempt) {
+                    Serial.println("Fast connect failed, falling back to full scan...");
+                    cache.valid = 0;
+                    startAttempt(now);
+                } else {
+                    enterBackoff(now);
+                }
+            }
+            break;
+
+        case State::CONNECTED:
+            if (linkLost || WiFi.status() != WL_CONNECTED) {
+                Serial.println("Wi-Fi connection lost, reconnecting...");
+                startAttempt(now);
+            }
+            break;
+
+        case State::BACKOFF:
+            if (now - stateSince >= backoff) {
+                backoff = backoff * 2 < backoffMax ? backoff * 2 : backoffMax;
+                startAttempt(now);
+            }
+            break;
         }
+    }
 
-        if (WiFi.status() == WL_CONNECTED) {
-            Serial.println("\nWi-Fi Connected!");
-            Serial.printf("IP Address: %s\n", WiFi.localIP().toString().c_str());
-        } else {
-            Serial.println("\nWi-Fi connection failed, will retry...");
+    bool connected() const { return state == State::CONNECTED; }
+    State getState() const { return state; }
+
+    // Blocks for at most `timeout` on a single association attempt, for
+    // callers that have nothing else to do (the deep-sleep cycle).
+    bool connect() {
+        if (state != State::CONNECTING && state != State::CONNECTED) startAttempt(millis());
+        while (state == State::CONNECTING) {
+            delay(10);
+            update();
         }
+        return connected();
     }
 
 private:
     const char* ssid;
     const char* pass;
     unsigned long timeout;
-    unsigned long lastAttempt;
+    unsigned long backoffMin;
+    unsigned long backoffMax;
+    unsigned long backoff;
+    unsigned long stateSince = 0;
+    uint32_t attemptStartUs = 0;
+    State state = State::IDLE;
+    bool fastAttempt = false;
+    WiFiCache& cache;
+
+    WiFiEventHandler gotIpHandler;
+    WiFiEventHandler disconnectedHandler;
+    volatile bool gotIp = false;
+    volatile bool linkLost = false;
+
+    void startAttempt(unsigned long now) {
+        Serial.printf("Connecting to Wi-Fi: %s\n", ssid);
+        gotIp = false;
+        linkLost = false;
+        state = State::CONNECTING;
+        stateSince = now;
+        attemptStartUs = micros();
+        diag.wifiAttempts++;
+        fastAttempt = WIFI_FAST_CONNECT && cache.valid;
+
+        if (fastAttempt) {
+            WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.mask), IPAddress(cache.dns));
+            WiFi.begin(ssid, pass, cache.channel, cache.bssid);
+        } else {
+            WiFi.config(0U, 0U, 0U);
+            WiFi.begin(ssid, pass);
+        }
+    }
+
+    unsigned long attemptTimeout() const { return fastAttempt ? WIFI_FAST_TIMEOUT_MS : timeout; }
+
+    void storeCache() {
+        memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+        cache.channel = (uint8_t)WiFi.channel();
+        cache.ip      = (uint32_t)WiFi.localIP();
+        cache.gateway = (uint32_t)WiFi.gatewayIP();
+        cache.mask    = (uint32_t)WiFi.subnetMask();
+        cache.dns     = (uint32_t)WiFi.dnsIP();
+        cache.valid   = 1;
+    }
+
+    void enterBackoff(unsigned long now) {
+        Serial.printf("Wi-Fi connection failed, retrying in %lu ms...\n", backoff);
+        state = State::BACKOFF;
+        stateSince = now;
+    }
+
+    // Without auto-reconnect the SDK gives up on its own for a wrong
+    // password or a missing AP; no need to wait out the timeout then.
+    static bool attemptRejected() {
+        wl_status_t status = WiFi.status();
+        return status == WL_NO_SSID_AVAIL || status == WL_CONNECT_FAILED || status == WL_WRONG_PASSWORD;
+    }
 };
 
-class BME280Sensor {
+// The sensors of this build, in channel order. The first BME280 is looked
+// for at either address unless a second one is fitted, which then takes
+// 0x77.
+BME280Sensor bme280(0x76, BME280_COUNT == 1);
+#if BME280_COUNT > 1
+BME280Sensor bme280b(0x77);
+#endif
+#if SHT3X
+Sht3xSensor sht3x;
+#endif
+#if BME280_COUNT > 1 && SHT3X
+SensorRegistry sensors(bme280, bme280b, sht3x);
+#elif BME280_COUNT > 1
+SensorRegistry sensors(bme280, bme280b);
+#elif SHT3X
+SensorRegistry sensors(bme280, sht3x);
+#else
+SensorRegistry sensors(bme280);
+#endif
+typedef decltype(sensors) Sensors;
+I2cBus i2c(I2C_SDA_PIN, I2C_SCL_PIN);
+
+// Renders uploads through a fixed window instead of a buffer sized for the
+// whole batch: the body is generated a few rows at a time while the
+// transport writes it, straight from the ring or the flash log, so peak RAM
+// for an upload does not grow with the record count.
+class DataSender : private BodySource {
 public:
-    BME280Sensor(uint8_t addr = 0x76) : addr(addr) {}
+    // Worst case per JSON row is "[4294967295," plus "-327.68," per 16-bit
+    // and "-2147483648," per 32-bit channel; WINDOW_STATS adds the count
+    // and min / max / stddev per channel. Field names are at most 22
+    // characters ("bme280_77_temperature"), plus "_min" etc. for the
+    // statistics. Quoted strings are budgeted at twice their length for
+    // escapes.
+    static constexpr size_t JSON_ROW_CAPACITY = 14 + 8 * NARROW_CHANNELS + 12 * WIDE_CHANNELS +
+                                                (WINDOW_STATS ? 6 + 23 * NARROW_CHANNELS + 31 * WIDE_CHANNELS : 0);
+    static constexpr size_t JSON_HEADER_CAPACITY = 96 + 2 * (sizeof(API_KEY) + sizeof(DEVICE_NAME)) +
+                                                   CHANNEL_COUNT * (26 + (WINDOW_STATS ? 90 : 0));
+    // DIAG_PAYLOAD appends a diag object of at most 353 characters, or
+    // 64 bytes in the binary format. A health object takes 61 characters
+    // plus a quoted id per sensor, 4 bytes in the binary format.
+    static constexpr size_t JSON_DIAG_CAPACITY   = DIAG_PAYLOAD ? 360 : 0;
+    static constexpr size_t BINARY_DIAG_SIZE     = DIAG_PAYLOAD ? 64 : 0;
+    static constexpr size_t JSON_HEALTH_CAPACITY = 64 + 24 * Sensors::SENSORS;
+    static constexpr size_t BINARY_HEALTH_SIZE   = 4;
+    static constexpr size_t JSON_CAPACITY = JSON_HEADER_CAPACITY + RTC_RING_SIZE * JSON_ROW_CAPACITY +
+                                            JSON_DIAG_CAPACITY + JSON_HEALTH_CAPACITY;
+    static constexpr size_t BINARY_HEADER_SIZE = 17 + sizeof(API_KEY) + sizeof(DEVICE_NAME) + CHANNEL_COUNT * 24;
+    static constexpr size_t BINARY_ROW_SIZE = 4 + 2 * NARROW_CHANNELS + 4 * WIDE_CHANNELS +
+                                              (WINDOW_STATS ? 2 + sizeof(ChannelSpread) * CHANNEL_COUNT : 0);
+    static constexpr size_t BINARY_CAPACITY = BINARY_HEADER_SIZE + RTC_RING_SIZE * BINARY_ROW_SIZE +
+                                              BINARY_DIAG_SIZE + BINARY_HEALTH_SIZE;
+    // Largest message for a full ring, for transports that have to buffer
+    // the whole body.
+    static constexpr size_t PAYLOAD_CAPACITY = PAYLOAD_FORMAT == PAYLOAD_BINARY ? BINARY_CAPACITY : JSON_CAPACITY;
+    static constexpr const char* CONTENT_TYPE =
+        PAYLOAD_FORMAT == PAYLOAD_BINARY ? "application/octet-stream" : "application/json";
+
+    // Every piece of the body (header, one row, trailer) must fit the
+    // window on its own; rows are packed until the window is full.
+    static constexpr size_t WINDOW_SIZE = JSON_HEADER_CAPACITY >= 512 ? JSON_HEADER_CAPACITY + 1 : 512;
+    static_assert(JSON_DIAG_CAPACITY + JSON_HEALTH_CAPACITY + 2 < WINDOW_SIZE && JSON_ROW_CAPACITY < WINDOW_SIZE &&
+                  BINARY_HEADER_SIZE <= WINDOW_SIZE, "Payload pieces must fit the stream window");
+
+    // `config` is the runtime config in use, which a config block in the
+    // backend's reply is applied on top of. The faults in `health` are
+    // reported with the next upload and cleared once it went through.
+    DataSender(Transport& transport, const Sensors& sensors, const char* apiKey, const char* deviceName,
+               const RuntimeConfig& config, HealthState& health)
+        : transport(transport), sensors(sensors), apiKey(apiKey), deviceName(deviceName), config(config),
+          health(health) {}
+
+    // Sends all samples of the batch in one message: metadata once, then
+    // one row per sample, as JSON or (PAYLOAD_BINARY) the packed format.
+    bool sendBatch(const SampleBatch& batch) {
+        if (WiFi.status() != WL_CONNECTED) {
+            Serial.println("Wi-Fi disconnected, cannot send data.");
+            return false;
+        }
+
+        diag.sampleHeap();
+        this->batch = &batch;
+        complete = false;
+        BodyStream body(*this, window, sizeof(window));
+        size_t len = body.measure();
+        if (!complete) {
+            Serial.println("Could not render the batch, not sent.");
+            this->batch = nullptr;
+            return false;
+        }
 
-    bool begin() {
-        if (!bme.begin(addr)) {
-            addr = 0x77;
-            if (!bme.begin(addr)) return false;
+        uint32_t start = micros();
+        bool sent = transport.send(body, CONTENT_TYPE, batch.sequence);
+        diag.upload.record(micros() - start);
+        diag.uploadAttempts++;
+        diag.uploadRetries = transport.retries();
+        this->batch = nullptr;
+        if (!sent) {
+            diag.uploadFailures++;
+            return false;
         }
+        diag.bytesSent += len;
+
+        Serial.printf("Sent %u readings (%u bytes) via %s\n", (unsigned)batch.count, (unsigned)len,
+                      transport.name());
+        health.pending = 0;
+        health.busRecoveries = 0;
+        health.crashResets = 0;
+#if REMOTE_CONFIG
+        readReply();
+#endif
         return true;
     }
 
-    float getAverageTemperature() { return measureAverage(&BME280Sensor::readTemperature); }
-    float getAverageHumidity()    { return measureAverage(&BME280Sensor::readHumidity); }
-    float getAveragePressure()    { return measureAverage(&BME280Sensor::readPressure); }
+    void maintain() { transport.maintain(); }
+    void stop()     { transport.stop(); }
+
+    // Hands out a config block with a new version that came back with an
+    // upload since the last call.
+    bool takeConfig(RuntimeConfig& out) {
+        if (!configPending) return false;
+        configPending = false;
+        out = pendingConfig;
+        return true;
+    }
 
 private:
-    Adafruit_BME280 bme;
-    uint8_t addr;
-
-    float measureAverage(float (BME280Sensor::*readFunc)()) {
-        float sum = 0.0f;
-        int validCount = 0;
-
-        for (int i = 0; i < SAMPLE_SIZE; i++) {
-            float val = (this->*readFunc)();
-            if (!isnan(val)) {
-                sum += val;
-                validCount++;
+    enum class Part : uint8_t { HEADER, ROWS, TRAILER, DONE };
+
+    Transport& transport;
+    const Sensors& sensors;
+    const char* apiKey;
+    const char* deviceName;
+    const RuntimeConfig& config;
+    HealthState& health;
+    uint8_t window[WINDOW_SIZE];
+    RuntimeConfig pendingConfig;
+    bool configPending = false;
+
+    // Position in the body being generated.
+    const SampleBatch* batch = nullptr;
+    Part part = Part::DONE;
+    size_t rowsWritten = 0;
+    PackedSample row;
+    uint32_t rowTime = 0;   // Unix time of the current row, or its age
+    bool failed = false;
+    bool complete = false;  // the last walk reached the end with every row
+
+#if REMOTE_CONFIG
+    // The window is free once the body has been sent, so the reply is
+    // parsed in place. A block that repeats the version in use changes
+    // nothing; a reply without "v" is not meant as one.
+    static_assert(ConfigParser::MAX_BLOCK < WINDOW_SIZE, "A config block must fit the stream window");
+
+    void readReply() {
+        char* text = reinterpret_cast<char*>(window);
+        size_t n = transport.takeReply(text, ConfigParser::MAX_BLOCK);
+        if (!n) return;
+        text[n] = '\0';
+
+        RuntimeConfig next = configPending ? pendingConfig : config;
+        if (!ConfigParser::parse(text, next, RTC_RING_SIZE)) {
+            if (strstr(text, "\"v\"")) Serial.println("Config block rejected, keeping the current one");
+        } else if (next.version != config.version) {
+            pendingConfig = next;
+            configPending = true;
+        }
+    }
+#endif
+
+    void rewind() override {
+        batch->source->rewind();
+        part = Part::HEADER;
+        rowsWritten = 0;
+        rowTime = timestamped() ? batch->firstUnixSec : batch->firstAgeSec;
+        failed = false;
+    }
+
+    size_t fill(uint8_t* buf, size_t capacity) override {
+#if PAYLOAD_FORMAT == PAYLOAD_BINARY
+        BinaryWriter out(buf, capacity);
+#else
+        PayloadWriter out(reinterpret_cast<char*>(buf), capacity);
+#endif
+        while (part != Part::DONE) {
+            size_t mark = out.length();
+            writePart(out);
+            if (!out.ok()) {
+                out.truncate(mark);
+                failed = mark == 0;
+                break;
             }
-            delay(50);
-            yield();
+            advance();
         }
+        if (part == Part::DONE) complete = rowsWritten == batch->count;
+        return failed ? 0 : out.length();
+    }
 
-        if (validCount == 0) return NAN;
-        return sum / validCount;
+    // Moves past the part just written, fetching the next row if any.
+    void advance() {
+        switch (part) {
+        case Part::HEADER:
+        case Part::ROWS:
+            if (part == Part::ROWS) rowsWritten++;
+            if (rowsWritten < batch->count && batch->source->next(row)) {
+                if (part == Part::ROWS && timestamped()) rowTime += row.deltaSec;
+                else if (part == Part::ROWS) rowTime -= row.deltaSec < rowTime ? row.deltaSec : rowTime;
+                part = Part::ROWS;
+            } else {
+                part = Part::TRAILER;
+            }
+            break;
+        case Part::TRAILER:
+        case Part::DONE:
+            part = Part::DONE;
+            break;
+        }
     }
 
-    float readTemperature() { return bme.readTemperature(); }
-    float readHumidity()    { return bme.readHumidity(); }
-    float readPressure()    { return bme.readPressure() / 1.0F; }
-};
+#if PAYLOAD_FORMAT == PAYLOAD_BINARY
+    void writePart(BinaryWriter& out) const {
+        if (part == Part::HEADER) writeHeaderBinary(out);
+        else if (part == Part::ROWS) writeRowBinary(out, row, rowsWritten);
+        else if (part == Part::TRAILER) writeTrailerBinary(out);
+    }
+#else
+    void writePart(PayloadWriter& out) const {
+        if (part == Part::HEADER) {
+            writeHeaderJson(out);
+        } else if (part == Part::ROWS) {
+            if (rowsWritten > 0) out.raw(',');
+            writeRowJson(out, row, rowTime);
+        } else if (part == Part::TRAILER) {
+            out.raw(']');
+            if (DIAG_PAYLOAD) writeDiagJson(out);
+            if (healthReported()) writeHealthJson(out);
+            out.raw('}');
+        }
+    }
+#endif
 
-class DataSender {
-public:
-    DataSender(const char* serverUrl, const char* endpoint, const char* apiKey)
-        : serverUrl(serverUrl), endpoint(endpoint), apiKey(apiKey) {}
+    // Rows carry their Unix time once the clock has been synced, before
+    // that their age at send time.
+    bool timestamped() const { return batch->firstUnixSec != 0; }
 
-    void send(float temperature, float humidity, float pressure) {
-        if (WiFi.status() != WL_CONNECTED) {
-            Serial.println("Wi-Fi disconnected, cannot send data.");
-            return;
+    // While a sensor is down every upload says so; other faults go out once.
+    bool healthReported() const { return health.pending || health.downSensors; }
+
+    // Channels of the first sensor keep their plain names, the others are
+    // prefixed with their sensor's id. `suffix` names a statistic.
+    void writeFieldJson(PayloadWriter& out, size_t ch, const char* suffix) const {
+        const Sensors::Channel& c = sensors.channel(ch);
+        out.raw(",\"");
+        if (c.prefixed) out.raw(sensors.sensorId(ch)).raw('_');
+        out.raw(c.info->name).raw(suffix).raw('"');
+    }
+
+    void writeHeaderJson(PayloadWriter& out) const {
+        out.raw("{\"api_key\":").quoted(apiKey);
+        out.raw(",\"device\":").quoted(deviceName);
+        out.raw(",\"seq\":").number(batch->sequence);
+        out.raw(timestamped() ? ",\"fields\":[\"ts\"" : ",\"fields\":[\"age\"");
+        for (size_t ch = 0; ch < sensors.size(); ch++) writeFieldJson(out, ch, "");
+#if WINDOW_STATS
+        out.raw(",\"count\"");
+        for (size_t ch = 0; ch < sensors.size(); ch++) {
+            writeFieldJson(out, ch, "_min");
+            writeFieldJson(out, ch, "_max");
+            writeFieldJson(out, ch, "_std");
         }
+#endif
+        out.raw(']');
+        out.raw(",\"readings\":[");
+    }
 
-        String url = String(serverUrl) + endpoint;
-        http.begin(client, url);
-        http.addHeader("Content-Type", "application/json");
+    // Missing channels are null.
+    void writeRowJson(PayloadWriter& out, const PackedSample& s, uint32_t time) const {
+        out.raw('[').number(time);
+        for (size_t ch = 0; ch < sensors.size(); ch++) {
+            out.raw(',');
+            if (s.hasChannel(ch)) out.fixed(sensors.value(s.values, ch), decimalsOf(ch));
+            else out.raw("null");
+        }
+#if WINDOW_STATS
+        out.raw(',').number(s.count);
+        for (size_t ch = 0; ch < sensors.size(); ch++) {
+            if (!s.hasChannel(ch)) {
+                out.raw(",null,null,null");
+                continue;
+            }
+            const ChannelSpread& sp = s.spread[ch];
+            int32_t base = sensors.channel(ch).wide ? sensors.value(s.values, ch) : 0;
+            uint8_t decimals = decimalsOf(ch);
+            out.raw(',').fixed(base + sp.min, decimals).raw(',').fixed(base + sp.max, decimals);
+            out.raw(',').fixed(sp.std, formatOf(sensors.channel(ch).info->quantity).stdDecimals);
+        }
+#endif
+        out.raw(']');
+    }
 
-        String payload = "{";
-        payload += "\"api_key\":\"" + String(apiKey) + "\",";
-        payload += "\"content\":{";
-        payload += "\"temperature\":" + String(temperature, 2) + ",";
-        payload += "\"humidity\":" + String(humidity, 2) + ",";
-        payload += "\"pressure\":" + String(pressure, 0);
-        payload += "}}";
+    uint8_t decimalsOf(size_t ch) const { return formatOf(sensors.channel(ch).info->quantity).decimals; }
 
-        int code = http.POST(payload);
-        if (code > 0) {
-            Serial.printf("Data sent! HTTP code: %d\n", code);
-        } else {
-            Serial.printf("Failed to send data: %s\n", http.errorToString(code).c_str());
+    // Timers are [count, last us, max us].
+    static void writeDiagJson(PayloadWriter& out) {
+        out.raw(",\"diag\":{\"sensor_us\":");
+        writeTimerJson(out, diag.sensor);
+        out.raw(",\"wifi_us\":");
+        writeTimerJson(out, diag.wifi);
+        out.raw(",\"upload_us\":");
+        writeTimerJson(out, diag.upload);
+        out.raw(",\"rejected\":").number(diag.sensorRejected);
+        out.raw(",\"wifi_attempts\":").number(diag.wifiAttempts);
+        out.raw(",\"wifi_failures\":").number(diag.wifiFailures);
+        out.raw(",\"upload_attempts\":").number(diag.uploadAttempts);
+        out.raw(",\"upload_failures\":").number(diag.uploadFailures);
+        out.raw(",\"retries\":").number(diag.uploadRetries);
+        out.raw(",\"bytes_sent\":").number(diag.bytesSent);
+        out.raw(",\"free_heap\":").number(diag.freeHeap);
+        out.raw(",\"max_block\":").number(diag.maxFreeBlock);
+        out.raw('}');
+    }
+
+    // Sensors that are down by id, and the counts since the last upload.
+    void writeHealthJson(PayloadWriter& out) const {
+        out.raw(",\"health\":{\"down\":[");
+        bool first = true;
+        for (size_t s = 0; s < Sensors::SENSORS; s++) {
+            if (!(health.downSensors >> s & 1)) continue;
+            if (!first) out.raw(',');
+            out.quoted(sensors.sensorName(s));
+            first = false;
         }
-        http.end();
+        out.raw("],\"bus_recoveries\":").number((uint32_t)health.busRecoveries);
+        out.raw(",\"crash_resets\":").number((uint32_t)health.crashResets);
+        out.raw('}');
     }
 
-private:
-    HTTPClient http;
-    WiFiClient client;
-    const char* serverUrl;
-    const char* endpoint;
-    const char* apiKey;
+    static void writeTimerJson(PayloadWriter& out, const PhaseTimer& t) {
+        out.raw('[').number(t.count).raw(',').number(t.lastUs).raw(',').number(t.maxUs).raw(']');
+    }
+
+    // Binary format, version 2, all fields little-endian:
+    //   "EA" magic, u8 version, u8 flags, u32 sequence,
+    //   u32 age of the first reading (s) or, with flag 0x04, its Unix
+    //   time, u16 reading count,
+    //   u8 length + api key, u8 length + device name,
+    //   u8 channel count, then per channel u8 quantity (0 temperature,
+    //   1 humidity, 2 pressure) and u8 length + field name,
+    //   then per reading: u16 seconds since the previous reading (0 for
+    //   the first), u16 mask of missing channels, and per channel an
+    //   i16 in 0.01 degC or 0.01 %RH, or a u32 in Pa.
+    // Flag 0x01 (WINDOW_STATS) appends to each reading: u16 count of
+    //   filtered bursts in the window, then per channel i16 min / i16 max / u16 stddev in the channel's unit;
+    //   for pressure, min and max are relative to the mean and the
+    //   stddev is in 0.1 Pa.
+    // Flag 0x02 (DIAG_PAYLOAD) appends after the readings: u32 count /
+    //   last us / max us for the sensor, Wi-Fi and upload timers, u32
+    //   rejected readings, u16 Wi-Fi attempts / failures, u16 upload
+    //   attempts / failures, u32 retries, bytes sent, free heap and
+    //   largest free block.
+    // Flag 0x04 (clock synced): the header carries the first reading's
+    //   Unix time instead of its age; each later one is that plus the
+    //   deltas.
+    // Flag 0x08 (health) appends after that: u16 mask of the channels
+    //   whose sensor is down, u8 I2C bus recoveries and u8 crash resets
+    //   since the last upload.
+    static constexpr uint8_t BINARY_FLAG_WINDOW_STATS = 0x01;
+    static constexpr uint8_t BINARY_FLAG_DIAG         = 0x02;
+    static constexpr uint8_t BINARY_FLAG_UNIX_TIME    = 0x04;
+    static constexpr uint8_t BINARY_FLAG_HEALTH       = 0x08;
+
+    void writeHeaderBinary(BinaryWriter& out) const {
+        out.u8('E').u8('A').u8(2);
+        out.u8((WINDOW_STATS ? BINARY_FLAG_WINDOW_STATS : 0) | (DIAG_PAYLOAD ? BINARY_FLAG_DIAG : 0) |
+               (timestamped() ? BINARY_FLAG_UNIX_TIME : 0) | (healthReported() ? BINARY_FLAG_HEALTH : 0));
+        out.u32(batch->sequence).u32(timestamped() ? batch->firstUnixSec : batch->firstAgeSec);
+        out.u16((uint16_t)batch->count);
+        out.str(apiKey).str(deviceName);
+
+        out.u8((uint8_t)sensors.size());
+        for (size_t ch = 0; ch < sensors.size(); ch++) {
+            const Sensors::Channel& c = sensors.channel(ch);
+            char name[32];
+            snprintf(name, sizeof(name), "%s%s%s", c.prefixed ? sensors.sensorId(ch) : "", c.prefixed ? "_" : "",
+                     c.info->name);
+            out.u8((uint8_t)c.info->quantity).str(name);
+        }
+    }
+
+    void writeRowBinary(BinaryWriter& out, const PackedSample& s, size_t index) const {
+        out.u16(index > 0 ? s.deltaSec : 0).u16(s.missing);
+        for (size_t ch = 0; ch < sensors.size(); ch++) {
+            int32_t v = sensors.value(s.values, ch);
+            if (sensors.channel(ch).wide) out.u32((uint32_t)v);
+            else out.i16((int16_t)v);
+        }
+#if WINDOW_STATS
+        out.u16(s.count);
+        for (size_t ch = 0; ch < sensors.size(); ch++) {
+            out.i16(s.spread[ch].min).i16(s.spread[ch].max).u16(s.spread[ch].std);
+        }
+#endif
+    }
+
+    void writeTrailerBinary(BinaryWriter& out) const {
+        if (DIAG_PAYLOAD) writeDiagBinary(out);
+        if (healthReported()) {
+            out.u16(sensors.channelMask(health.downSensors)).u8(health.busRecoveries).u8(health.crashResets);
+        }
+    }
+
+    static void writeDiagBinary(BinaryWriter& out) {
+        for (const PhaseTimer* t : { &diag.sensor, &diag.wifi, &diag.upload }) {
+            out.u32(t->count).u32(t->lastUs).u32(t->maxUs);
+        }
+        out.u32(diag.sensorRejected);
+        out.u16(diag.wifiAttempts).u16(diag.wifiFailures);
+        out.u16(diag.uploadAttempts).u16(diag.uploadFailures);
+        out.u32(diag.uploadRetries).u32(diag.bytesSent).u32(diag.freeHeap).u32(diag.maxFreeBlock);
+    }
 };
 
-WiFiManager wifiManager(WIFI_SSID, WIFI_PASS, WIFI_TIMEOUT_MS);
-BME280Sensor sensor;
-DataSender sender(SERVER_URL, ENDPOINT, API_KEY);
+RtcState rtc;
+#if REMOTE_CONFIG
+// The parameters the backend can retune, see remote_config.h.
+RuntimeConfig& config = rtc.data.config;
+ConfigStore configStore;
+#else
+const RuntimeConfig config = RuntimeConfig::defaults();
+#endif
+WiFiManager wifiManager(WIFI_SSID, WIFI_PASS, WIFI_TIMEOUT_MS, WIFI_BACKOFF_MIN_MS, WIFI_BACKOFF_MAX_MS,
+                        rtc.data.wifiCache);
+#if TRANSPORT == TRANSPORT_MQTT
+MqttTransport transport(MQTT_HOST, MQTT_PORT, MQTT_USER, MQTT_PASS, DEVICE_NAME, DataSender::PAYLOAD_CAPACITY);
+#elif TRANSPORT == TRANSPORT_UDP
+UdpTransport transport(UDP_HOST, UDP_PORT);
+#elif TLS
+HttpTransport transport(SERVER_URL, ENDPOINT, rtc.data.tls);
+#else
+HttpTransport transport(SERVER_URL, ENDPOINT);
+#endif
+static_assert(!TLS || TRANSPORT == TRANSPORT_HTTP, "TLS is only implemented for the HTTP transport");
+DataSender sender(transport, sensors, API_KEY, DEVICE_NAME, config, rtc.data.health);
+#if SPILL_LOG
+SpillLog spill;
+// Only HTTP streams the body; the others buffer a message of up to a full ring.
+static_assert(SPILL_CHUNK >= 1 && SPILL_CHUNK <= 0xFFFF, "SPILL_CHUNK out of range");
+static_assert(TRANSPORT == TRANSPORT_HTTP || SPILL_CHUNK <= RTC_RING_SIZE,
+              "SPILL_CHUNK must fit the transport's message buffer");
+#endif
 
-unsigned long lastSend = INTERVAL_MS;
+static_assert(UPLOAD_EVERY >= 1 && UPLOAD_EVERY <= RTC_RING_SIZE, "UPLOAD_EVERY must fit in the RTC ring");
+static_assert(HEALTH_RETRY_MIN_MS > 0 && HEALTH_RETRY_MIN_MS <= HEALTH_RETRY_MAX_MS,
+              "HEALTH_RETRY_MIN_MS must be positive and at most HEALTH_RETRY_MAX_MS");
 
-void setup() {
-    Serial.begin(115200);
-    Wire.begin();
+#if OTA
+// Over HTTP the check uses the upload socket, so with TLS the image has to
+// come from the pinned server as well.
+#if TRANSPORT == TRANSPORT_HTTP
+OtaUpdater ota(transport.socket(), OTA_URL, FIRMWARE_VERSION);
+#else
+WiFiClient otaClient;
+OtaUpdater ota(otaClient, OTA_URL, FIRMWARE_VERSION);
+#endif
+#endif
 
-    if (!sensor.begin()) {
-        Serial.println("BME280 sensor not found. Check wiring!");
-        while (1) delay(1000);
+// With WIFI_SLEEP the Wi-Fi task polls less often, since every wake-up
+// cuts a sleep period short.
+static constexpr bool     WIFI_SLEEPS    = WIFI_SLEEP != WIFI_NONE_SLEEP;
+static constexpr uint32_t WIFI_TASK_MS   = WIFI_SLEEPS ? 1000 : 100;
+static constexpr uint32_t UPLOAD_TASK_MS = 1000;
+// Worst case for one upload: DNS + connect, then waiting for the response.
+static constexpr uint32_t UPLOAD_BUDGET_MS = CONNECT_TIMEOUT_MS * 2 + TCP_TIMEOUT_MS;
+
+// Only used without DEEP_SLEEP; a deep-sleep wake runs its one cycle
+// straight from setup().
+Scheduler<4> scheduler;
+int sampleTaskId = -1;
+Sensors::Window window;  // WINDOW_STATS accumulators for the current report
+bool wasConnected = false;
+bool flushArmed = true;     // re-armed by a new sample or a fresh connection
+
+#if SPILL_LOG
+// Moves the oldest ring record to flash instead of letting push() drop it.
+void spillOldest() {
+    SampleRing<RTC_RING_SIZE>& ring = rtc.data.samples;
+    if (!spill.begin() || !spill.append(ring.at(0), ring.firstSec)) return;
+    ring.popFront(1);
+    rtc.data.spillPending = spill.pending();
+}
+
+#endif
+
+// With DEADBAND a reading is only queued when a channel moved past its
+// threshold since the last queued one or the heartbeat ran out, so steady
+// conditions cost neither an upload nor a radio wake.
+int32_t deadbandOf(Quantity q) {
+    return q == Quantity::TEMPERATURE ? config.deadbandTemp :
+           q == Quantity::HUMIDITY    ? config.deadbandHum  : config.deadbandPres;
+}
+
+// A channel that appeared or dropped out counts as a change.
+bool worthReporting(const PackedSample& s, uint32_t nowSec) {
+    const DeadbandState& last = rtc.data.deadband;
+    if (!DEADBAND || !last.valid) return true;
+    if (nowSec - last.atSec >= config.heartbeatS) return true;
+    if (s.missing != last.missing) return true;
+
+    for (size_t ch = 0; ch < sensors.size(); ch++) {
+        if (!s.hasChannel(ch)) continue;
+        int32_t moved = sensors.value(s.values, ch) - sensors.value(last.values, ch);
+        if (abs(moved) > deadbandOf(sensors.channel(ch).info->quantity)) return true;
     }
+    return false;
+}
 
-    wifiManager.update();
+void rememberReported(const PackedSample& s, uint32_t nowSec) {
+    DeadbandState& last = rtc.data.deadband;
+    last.values  = s.values;
+    last.missing = s.missing;
+    last.atSec   = nowSec;
+    last.valid   = 1;
 }
 
-void loop() {
-    wifiManager.update();
+#if ADAPTIVE_INTERVAL
+// Report intervals are INTERVAL_MIN_MS times a power of two, so each
+// interval's slots are also slots of the shortest one and a change of
+// interval stays on the grid.
+constexpr int intervalShiftOf(uint32_t ms) {
+    int shift = 0;
+    while (ms > INTERVAL_MIN_MS && ms % 2 == 0) {
+        ms /= 2;
+        shift++;
+    }
+    return ms == INTERVAL_MIN_MS ? shift : -1;
+}
+
+static constexpr int MAX_INTERVAL_SHIFT   = intervalShiftOf(INTERVAL_MAX_MS);
+static constexpr int START_INTERVAL_SHIFT = intervalShiftOf(INTERVAL_MS);
+static_assert(MAX_INTERVAL_SHIFT >= 0 && START_INTERVAL_SHIFT >= 0 && START_INTERVAL_SHIFT <= MAX_INTERVAL_SHIFT,
+              "INTERVAL_MS and INTERVAL_MAX_MS must be INTERVAL_MIN_MS times a power of two");
+
+static constexpr int32_t ADAPT_TEMP_SCALED = (int32_t)(ADAPT_TEMP * 100 + 0.5f);
+static constexpr int32_t ADAPT_HUM_SCALED  = (int32_t)(ADAPT_HUM * 100 + 0.5f);
+
+constexpr int32_t adaptThresholdOf(Quantity q) {
+    return q == Quantity::TEMPERATURE ? ADAPT_TEMP_SCALED :
+           q == Quantity::HUMIDITY    ? ADAPT_HUM_SCALED  : ADAPT_PRES;
+}
+
+// A channel is changing when its move since the previous sample,
+// extrapolated to one INTERVAL_MIN_MS, or with WINDOW_STATS its standard
+// deviation over the window, exceeds its ADAPT_* threshold.
+bool changing(const PackedSample& s, uint32_t nowSec) {
+    const AdaptiveState& last = rtc.data.adaptive;
+    uint32_t elapsedSec = nowSec - last.atSec;
+
+    for (size_t ch = 0; ch < sensors.size(); ch++) {
+        if (!s.hasChannel(ch)) continue;
+        Quantity q = sensors.channel(ch).info->quantity;
+        int32_t threshold = adaptThresholdOf(q);
+#if WINDOW_STATS
+        QuantityFormat f = formatOf(q);
+        if (s.spread[ch].std > threshold * (f.stdDecimals > f.decimals ? 10 : 1)) return true;
+#endif
+        if (!last.valid || !elapsedSec || (last.missing & (1u << ch))) continue;
+        int64_t moved = abs(sensors.value(s.values, ch) - sensors.value(last.values, ch));
+        if (moved * INTERVAL_MIN_MS > (int64_t)threshold * elapsedSec * 1000) return true;
+    }
+    return false;
+}
 
-    if (WiFi.status() != WL_CONNECTED) return;
+// Any change drops straight to the shortest interval; each flat sample
+// doubles it, up to INTERVAL_MAX_MS. Runs on every sample, reported or
+// not.
+void adaptInterval(const PackedSample& s, uint32_t nowSec) {
+    AdaptiveState& a = rtc.data.adaptive;
+    int shift = a.valid ? a.intervalShift : START_INTERVAL_SHIFT;
+    int next = changing(s, nowSec) ? 0 : !a.valid || shift == MAX_INTERVAL_SHIFT ? shift : shift + 1;
+    if (next != shift) Serial.printf("Report interval now %lu s\n", (unsigned long)(((uint32_t)INTERVAL_MIN_MS << next) / 1000));
 
-    unsigned long now = millis();
-    if (now - lastSend >= INTERVAL_MS) {
-        lastSend = now;
+    a.values = s.values;
+    a.missing = s.missing;
+    a.atSec = nowSec;
+    a.intervalShift = (uint8_t)next;
+    a.valid = 1;
+}
+#endif
 
-        float temp = sensor.getAverageTemperature();
-        float hum  = sensor.getAverageHumidity();
-        float pres = sensor.getAveragePressure();
+// The finest slot grid; every report interval is a multiple of it.
+uint32_t slotMs() {
+    return ADAPTIVE_INTERVAL ? INTERVAL_MIN_MS : config.intervalMs;
+}
 
-        if (isnan(temp) || isnan(hum) || isnan(pres)) {
-            Serial.println("Skipping send due to invalid sensor averages.");
-            return;
+uint32_t reportIntervalMs() {
+#if ADAPTIVE_INTERVAL
+    const AdaptiveState& a = rtc.data.adaptive;
+    return slotMs() << (a.valid ? a.intervalShift : START_INTERVAL_SHIFT);
+#else
+    return config.intervalMs;
+#endif
+}
+
+// A sensor that went down or came back is reported with the next upload.
+void noteSensorState() {
+    HealthState& h = rtc.data.health;
+    uint8_t down = sensors.downMask();
+    if (down == h.downSensors) return;
+    h.downSensors = down;
+    h.pending = 1;
+}
+
+// Probes the sensors that are down. If one stays missing with SDA held
+// low, the bus is clocked free and they are probed once more. Returns
+// true if any sensor is up.
+bool probeSensors() {
+    bool any = sensors.begin();
+    if (!sensors.allUp() && i2c.recover()) {
+        Serial.println("I2C bus was held low, recovered");
+        HealthState& h = rtc.data.health;
+        if (h.busRecoveries < 0xFF) h.busRecoveries++;
+        h.pending = 1;
+        any = sensors.begin();
+    }
+    noteSensorState();
+    return any;
+}
+
+// Filtered readings of every sensor, timed for the diagnostics.
+template <int READINGS>
+SweepResult sampleSensors(Sensors::Window* into = nullptr) {
+    uint32_t start = micros();
+    SweepResult r = sensors.sample<READINGS>(into);
+    diag.sensor.record(micros() - start);
+    diag.sensorRejected += r.rejected;
+    noteSensorState();
+    return r;
+}
+
+// Takes one report and queues it in RTC memory. Sampling does not depend
+// on Wi-Fi, so readings keep accumulating while offline. A report is kept
+// as long as one channel has a value; the others are marked missing.
+void takeSample() {
+    rtc.data.sequence++;
+
+#if WINDOW_STATS
+    // The background task fills the window when running always-on; a
+    // deep-sleep wake (or an empty window) splits the report burst into
+    // STATS_BURSTS filtered bursts instead.
+    if (window.empty()) {
+        for (int i = 0; i < Sensors::STATS_BURSTS; i++) sampleSensors<Sensors::STATS_READINGS>(&window);
+    }
+
+    PackedSample sample = sensors.pack(window);
+    window.reset();
+#else
+    PackedSample sample = sensors.pack(sampleSensors<Sensors::SAMPLES_PER_REPORT>());
+#endif
+
+    if (sample.missing == ALL_CHANNELS_MISSING) {
+        rtc.data.sensorFailures++;
+        Serial.println("Skipping sample, no sensor gave a valid reading.");
+        return;
+    }
+    rtc.data.sensorFailures = 0;
+
+    uint32_t now = rtc.nowSec();
+#if ADAPTIVE_INTERVAL
+    adaptInterval(sample, now);
+#endif
+    if (!worthReporting(sample, now)) {
+        rtc.data.suppressedSamples++;
+        return;
+    }
+    rememberReported(sample, now);
+
+#if SPILL_LOG
+    if (rtc.data.samples.full()) spillOldest();
+#endif
+    if (!rtc.data.samples.push(sample, now)) {
+        rtc.data.droppedSamples++;
+    }
+}
+
+// Records keep device-clock seconds; they are converted on the way out,
+// so readings taken before the first sync get their Unix time too.
+uint32_t unixTimeOf(uint32_t deviceSec) {
+    return rtc.clockSynced() ? rtc.epochSec(deviceSec) : 0;
+}
+
+// Sampling runs on a slotMs() grid of the wall clock, so a record's time
+// is its slot and nodes report on the same boundaries. Before the first
+// sync the grid follows the device clock. A sample belongs to the slot
+// nearest to when it was started; the next one is due at the following
+// boundary of the current interval.
+uint64_t nextSlotMs(uint64_t startedWallMs, uint32_t intervalMs) {
+    uint32_t slot = slotMs();
+    uint64_t nearest = (startedWallMs + slot / 2) / slot * slot;
+    return (nearest / intervalMs + 1) * intervalMs;
+}
+
+#if TIME_SYNC
+// Without deep sleep a failed query is retried no sooner than this.
+static constexpr uint32_t NTP_RETRY_MS = 60000;
+
+SntpClient sntp(NTP_SERVER);
+bool syncTried = false;
+uint32_t syncTriedMs = 0;
+
+// Steps the clock when a resync is due; needs the link up. Returns true if
+// the clock was stepped.
+bool syncClock() {
+    if (!rtc.syncDue(NTP_RESYNC_S)) return false;
+    if (syncTried && millis() - syncTriedMs < NTP_RETRY_MS) return false;
+    syncTried = true;
+    syncTriedMs = millis();
+
+    uint64_t unixMs;
+    if (!sntp.query(unixMs)) return false;
+    rtc.applySync(unixMs);
+    Serial.printf("Clock synced, sleep timer drift %ld ppm\n", (long)rtc.data.clock.sleepDriftPpm);
+    return true;
+}
+#endif
+
+bool uploadDue() {
+    return rtc.data.samples.size() >= config.uploadEvery || (SPILL_LOG && rtc.data.spillPending) ||
+           rtc.data.health.pending;
+}
+
+#if SPILL_LOG
+// Replays the flash backlog oldest first, SPILL_CHUNK records per request
+// and at most SPILL_CHUNKS_PER_FLUSH requests per call, so a single call
+// does not grow with the backlog. Records are streamed from flash into the
+// request, so the chunk size costs no RAM. Returns true once it is empty.
+static constexpr int SPILL_CHUNKS_PER_FLUSH = 4;
+
+bool flushSpill() {
+    for (int i = 0; i < SPILL_CHUNKS_PER_FLUSH && rtc.data.spillPending; i++) {
+        if (!spill.begin()) return false;
+
+        SpillLog::Chunk chunk;
+        size_t n = spill.open(chunk, SPILL_CHUNK);
+        if (n == 0) {
+            rtc.data.spillPending = spill.pending();
+            break;
         }
 
-        sender.send(temp, hum, pres);
+        uint32_t now = rtc.nowSec();
+        SampleBatch batch = { &chunk, n, now - chunk.firstSec(), unixTimeOf(chunk.firstSec()),
+                              ++rtc.data.uploadSequence };
+        bool sent = sender.sendBatch(batch);
+        chunk.close();
+        if (!sent) {
+            rtc.data.sendFailures++;
+            return false;
+        }
+        spill.consume(n);
+        rtc.data.spillPending = spill.pending();
+        rtc.data.sendFailures = 0;
+        rtc.data.lastSendSec = now;
+    }
+    return rtc.data.spillPending == 0;
+}
+#endif
+
+// Sends everything queued in a single request; on failure the samples
+// stay in the ring for the next attempt. A flash backlog goes first so
+// the server receives reports in order. With nothing queued, unreported
+// health still goes out as a batch without readings.
+void flushSamples() {
+#if SPILL_LOG
+    if (!flushSpill()) return;
+#endif
+    SampleRing<RTC_RING_SIZE>& ring = rtc.data.samples;
+    if (ring.empty() && !rtc.data.health.pending) return;
+
+    uint32_t now = rtc.nowSec();
+    uint32_t first = ring.empty() ? now : ring.firstSec;
+    SampleRing<RTC_RING_SIZE>::Reader reader(ring);
+    SampleBatch batch = { &reader, ring.size(), now - first, unixTimeOf(first), ++rtc.data.uploadSequence };
+
+    if (!sender.sendBatch(batch)) {
+        rtc.data.sendFailures++;
+        return;
+    }
+    ring.popFront(batch.count);
+    rtc.data.sendFailures = 0;
+    rtc.data.lastSendSec = now;
+}
+
+// Moves the sample task onto the wall-clock grid after the clock stepped
+// or the interval changed: to the slot nearest its old deadline, or the
+// one after if that is past.
+void alignSampleTask() {
+    uint32_t interval = reportIntervalMs();
+    uint64_t wall = rtc.wallMs();
+    uint64_t slot = nextSlotMs(wall + scheduler.msUntil(sampleTaskId) - interval, interval);
+    if (slot <= wall) slot += interval;
+    scheduler.reschedule(sampleTaskId, (uint32_t)(slot - wall));
+}
+
+#if REMOTE_CONFIG
+// Takes over a config block that came back with an upload, for the next
+// wakes through RTC memory and for the next power-up through flash. Without
+// deep sleep the sample task moves to the new interval straight away.
+void applyRemoteConfig() {
+    RuntimeConfig next;
+    if (!sender.takeConfig(next)) return;
+    bool retimed = !ADAPTIVE_INTERVAL && next.intervalMs != config.intervalMs;
+    config = next;
+    if (!configStore.save(config)) Serial.println("Could not store the config in flash");
+    Serial.printf("Config version %u applied: interval %lu s, upload every %u\n", config.version,
+                  (unsigned long)(config.intervalMs / 1000), config.uploadEvery);
+
+    if (!DEEP_SLEEP && retimed) {
+        scheduler.setPeriod(sampleTaskId, reportIntervalMs());
+        alignSampleTask();
     }
 }
+#endif
+
+#if OTA
+// At most every OTA_CHECK_S, and only once an upload went through, so
+// the check never holds up one and the server is known to be reachable.
+void checkForUpdate() {
+    uint32_t now = rtc.nowSec();
+    if (rtc.data.sendFailures || (int32_t)(now - rtc.data.otaDueSec) < 0) return;
+    rtc.data.otaDueSec = now + OTA_CHECK_S;
+    rtc.save();
+    sender.stop();
+    ota.check();
+}
+#endif
+
+// Without deep sleep these run as independent scheduler tasks: Wi-Fi
+// upkeep every WIFI_TASK_MS, sampling on the report interval's grid, and an
+// upload check every UPLOAD_TASK_MS.
+void wifiTask() {
+    wifiManager.update();
+
+    bool connected = wifiManager.connected();
+    if (connected && !wasConnected) flushArmed = true;
+    wasConnected = connected;
+    if (connected) sender.maintain();
+#if TIME_SYNC
+    if (connected && syncClock()) alignSampleTask();
+#endif
+}
+
+// Low-rate filtered bursts across the whole window, for WINDOW_STATS.
+void statsTask() {
+    sampleSensors<Sensors::STATS_READINGS>(&window);
+}
+
+// Sensors that are down are probed again before a sample, at most every
+// sensorRetryMs() of the failed rounds so far. Past the longest backoff
+// each round is also reported, as a sign of life.
+uint32_t nextProbeMs = 0;
+uint16_t probeRounds = 0;
+
+void checkSensors() {
+    if (sensors.allUp()) {
+        probeRounds = 0;
+        return;
+    }
+    if ((int32_t)(millis() - nextProbeMs) < 0) return;
+    probeSensors();
+    if (sensors.allUp()) return;
+
+    if (probeRounds < 0xFFFF) probeRounds++;
+    uint32_t retryMs = sensorRetryMs(probeRounds);
+    if (retryMs == HEALTH_RETRY_MAX_MS) rtc.data.health.pending = 1;
+    nextProbeMs = millis() + retryMs;
+}
+
+// With ADAPTIVE_INTERVAL the task is put on the next slot of the interval
+// the sample just chose.
+void sampleTask() {
+    uint64_t startedWall = rtc.wallMs();
+    checkSensors();
+    takeSample();
+    if (ADAPTIVE_INTERVAL) {
+        uint32_t interval = reportIntervalMs();
+        uint64_t next = nextSlotMs(startedWall, interval);
+        uint64_t wall = rtc.wallMs();
+        scheduler.setPeriod(sampleTaskId, interval);
+        scheduler.reschedule(sampleTaskId, next > wall ? (uint32_t)(next - wall) : 0);
+    }
+    flushArmed = true;
+    rtc.save();
+}
+
+// Time an upload must have before the next sample. An interval shorter
+// than twice UPLOAD_BUDGET_MS leaves the first half of it, right after a
+// sample, so a slow upload can delay a sample but uploads do not stop.
+uint32_t uploadBudgetMs() {
+    uint32_t half = reportIntervalMs() / 2;
+    return UPLOAD_BUDGET_MS < half ? UPLOAD_BUDGET_MS : half;
+}
+
+// A failed flush is retried on the next sample or reconnect, not on every
+// check. An upload that could run into the next sample slot waits until
+// that sample has been taken.
+void uploadTask() {
+    if (!wifiManager.connected() || !flushArmed || !uploadDue()) return;
+    if (scheduler.msUntil(sampleTaskId) < uploadBudgetMs()) return;
+
+    flushArmed = false;
+    flushSamples();
+#if REMOTE_CONFIG
+    applyRemoteConfig();
+#endif
+#if OTA
+    if (scheduler.msUntil(sampleTaskId) >= uploadBudgetMs()) checkForUpdate();
+#endif
+    // Keep draining a flash backlog while requests succeed.
+    if (SPILL_LOG && rtc.data.spillPending && !rtc.data.sendFailures) flushArmed = true;
+    rtc.save();
+}
+
+#if DEEP_SLEEP
+// Set when this wake is one that the Wi-Fi backoff skips.
+bool wifiSkipped = false;
+
+// After a failed association the next 2^(n-1) - 1 wakes, for n failures in
+// a row, leave Wi-Fi alone, up to WIFI_WAKE_BACKOFF_MAX_MS worth of wakes.
+// Readings keep queueing in the ring and the spill log meanwhile, and the
+// skipped wakes run with the radio off.
+void backOffWifi() {
+    uint16_t& n = rtc.data.wifiFailures;
+    if (n < 0xFFFF) n++;
+    uint32_t maxSkips = WIFI_WAKE_BACKOFF_MAX_MS / reportIntervalMs();
+    uint32_t skips = n > 16 ? UINT32_MAX : (1ul << (n - 1)) - 1;
+    rtc.data.wifiSkips = (uint16_t)(skips < maxSkips ? skips : maxSkips < 0xFFFF ? maxSkips : 0xFFFF);
+    if (rtc.data.wifiSkips) Serial.printf("Wi-Fi down, skipping it for %u wakes\n", rtc.data.wifiSkips);
+}
+
+// The radio part of a deep-sleep wake: send what is queued and take what
+// came back with it.
+void uploadCycle() {
+    wifiManager.begin();
+    if (!wifiManager.connect()) {
+        backOffWifi();
+        return;
+    }
+    rtc.data.wifiFailures = 0;
+#if TIME_SYNC
+    syncClock();
+#endif
+    flushSamples();
+    sender.stop();
+#if REMOTE_CONFIG
+    applyRemoteConfig();
+#endif
+#if OTA
+    checkForUpdate();
+#endif
+}
+
+// A wake without any sensor sleeps for the retry backoff instead of the
+// interval, and goes through setup() again to probe. Queued readings and
+// the fault itself still go out when an upload is due; the radio is only
+// armed for a wake that will send.
+void faultSleep() {
+    uint16_t& failures = rtc.data.sensorFailures;
+    if (failures < 0xFFFF) failures++;
+    uint32_t retryMs = sensorRetryMs(failures);
+    if (retryMs == HEALTH_RETRY_MAX_MS) rtc.data.health.pending = 1;
+
+    rtc.data.uploadWake = 0;
+    if (uploadDue() && !rtc.data.radioOff && !wifiSkipped) uploadCycle();
+    bool radioNext = (uploadDue() || sensorRetryMs(failures + 1) == HEALTH_RETRY_MAX_MS) && !rtc.data.wifiSkips;
+
+    Serial.printf("No sensor answered (%u in a row), retrying in %lu s\n", failures, (unsigned long)(retryMs / 1000));
+    Serial.flush();
+    rtc.deepSleep(retryMs, radioNext ? RF_DEFAULT : RF_DISABLED);
+}
+#endif
+
+void setup() {
+    Serial.begin(115200);
+    // The core arms the hardware watchdog itself, at a fixed ~8 s; this
+    // only makes sure the software one is on too.
+    ESP.wdtEnable(WDTO_8S);
+    i2c.begin();
+    bool warmBoot = rtc.load();
+    if (crashReset()) {
+        HealthState& h = rtc.data.health;
+        if (h.crashResets < 0xFF) h.crashResets++;
+        h.pending = 1;
+    }
+#if REMOTE_CONFIG
+    // A pushed config is kept in flash across a power loss.
+    if (!warmBoot) {
+        config = RuntimeConfig::defaults();
+        configStore.load(config);
+    }
+#endif
+
+    // A node without sensors keeps running: it reports the fault and
+    // probes again later, see faultSleep() and checkSensors().
+    bool sensing = probeSensors();
+    if (!sensing) Serial.println("No sensor found. Check wiring!");
+
+#if SPILL_LOG
+    // RTC memory does not survive a power loss, the spill log does.
+    if (!warmBoot && spill.begin()) rtc.data.spillPending = spill.pending();
+#else
+    (void)warmBoot;
+#endif
+
+#if DEEP_SLEEP
+    wifiSkipped = rtc.data.wifiSkips > 0;
+    if (wifiSkipped) rtc.data.wifiSkips--;
+    if (!sensing) {
+        faultSleep();
+        return;
+    }
+    bool uploadWake = rtc.data.uploadWake;
+    rtc.data.uploadWake = 0;
+    if (!uploadWake) takeSample();
+
+    // The radio state of a wake is fixed when going to sleep, so only
+    // wakes that were armed for an upload may touch Wi-Fi.
+    if (uploadDue() && !rtc.data.radioOff && !wifiSkipped) uploadCycle();
+
+    // Sleep until the slot after the one this wake belongs to, the
+    // boundary nearest to when it booted; an upload wake belongs to the
+    // slot of the wake that handed over. deepSleep(0) would never wake up,
+    // so always sleep for something.
+    unsigned long awake = millis();
+    uint64_t wall = rtc.wallMs();
+    uint64_t nextSlot = nextSlotMs(wall - awake, reportIntervalMs());
+    unsigned long sleepMs = nextSlot > wall + 100 ? (unsigned long)(nextSlot - wall) : 100;
+
+    // Whether the next reading gets queued is unknown under DEADBAND, so
+    // wakes run with the radio off; one that queues an upload hands over to
+    // a short radio-on wake that only sends.
+    if (DEADBAND && uploadDue() && rtc.data.radioOff && !wifiSkipped) {
+        rtc.data.uploadWake = 1;
+        Serial.println("Change detected, waking with radio to upload");
+        Serial.flush();
+        rtc.deepSleep(1, RF_DEFAULT);
+    }
+    bool radioNext = (uploadDue() || (!DEADBAND && rtc.data.samples.size() + 1 >= config.uploadEvery)) &&
+                     !rtc.data.wifiSkips;
+
+    Serial.printf("Cycle %u done in %lu ms, %u queued, sleeping %lu ms\n",
+                  rtc.data.sequence, awake, (unsigned)rtc.data.samples.size(), sleepMs);
+    Serial.flush();
+    rtc.deepSleep(sleepMs, radioNext ? RF_DEFAULT : RF_DISABLED);
+#else
+    wifiManager.begin();
+    // Modem sleep powers the radio down between beacons; light sleep also
+    // suspends the CPU while loop() waits in delay(). Either way the station
+    // stays associated and wakes every WIFI_LISTEN_INTERVAL DTIM periods.
+    if (WIFI_SLEEPS) WiFi.setSleepMode(WIFI_SLEEP, WIFI_LISTEN_INTERVAL);
+    scheduler.add("wifi", wifiTask, WIFI_TASK_MS);
+    sampleTaskId = scheduler.add("sample", sampleTask, reportIntervalMs());
+    if (WINDOW_STATS) scheduler.add("stats", statsTask, STATS_SAMPLE_MS, STATS_SAMPLE_MS);
+    scheduler.add("upload", uploadTask, UPLOAD_TASK_MS);
+#endif
+}
+
+void loop() {
+    ESP.wdtFeed();
+    scheduler.runDue();
+
+    // delay() is what lets the SDK enter modem or light sleep; spinning on
+    // yield() keeps the CPU and radio fully powered.
+    uint32_t idleMs = WIFI_SLEEPS ? scheduler.msUntilNext() : 0;
+    if (idleMs) delay(idleMs);
+    else yield();
+}